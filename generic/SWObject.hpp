@@ -43,6 +43,41 @@
 	Tcl_SetObjResult(interp, $1.getObj());
 }   
 
+// lists passed in from Tcl are wrapped without conversion
+%typemap(in) const SWList& (SWList temp) {
+	temp = SWList($input);
+	$1 = &temp;
+}
+
+%typecheck(SWIG_TYPECHECK_POINTER) const SWList& {
+	int len;
+	$1 = (Tcl_ListObjLength(NULL, $input, &len) == TCL_OK);
+}
+
+// binary data passed in from Tcl, e.g. packed arrays, as bytes without conversion
+%typemap(in) const SWBytes& (SWBytes temp) {
+	int len;
+	const unsigned char *bytes = Tcl_GetByteArrayFromObj($input, &len);
+	if (!bytes) SWIG_exception_fail(SWIG_TypeError, "expected binary data");
+	temp = SWBytes(bytes, len);
+	$1 = &temp;
+}
+
+%typecheck(SWIG_TYPECHECK_POINTER) const SWBytes& {
+	$1 = 1;
+}
+
+// command prefixes are called in the interpreter of the caller
+%typemap(in) const SWCallback& (SWCallback temp) {
+	temp = SWCallback(interp, $input);
+	$1 = &temp;
+}
+
+%typecheck(SWIG_TYPECHECK_POINTER) const SWCallback& {
+	int len;
+	$1 = (Tcl_ListObjLength(NULL, $input, &len) == TCL_OK);
+}
+
 %{
 #include "SWObject.hpp"
 %}
@@ -52,8 +87,17 @@
 #include <tcl.h>
 //#include <tclTomMath.h>
 #include <string>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
 
 #include <cstddef>
+#include <stdint.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SWOBJECT_SSE2
+#endif
 enum utf8token { utf8lowbyte = 1, utf8doublet = 2, utf8triplet = 3, utf8quadruplet = 4, utf8highbyte, utf8fail };
 
 static utf8token utf8classify(unsigned char data) {
@@ -66,7 +110,26 @@ static utf8token utf8classify(unsigned char data) {
 }
 
 static bool valid_utf8(const char* data, std::size_t dataSize) {
-    for (std::size_t i = 0; i < dataSize; i++) {
+    std::size_t i = 0;
+    while (i < dataSize) {
+        // fast path: skip blocks of plain ASCII, which have no high bit set
+        if ((data[i] & 0x80) == 0) {
+#ifdef SWOBJECT_SSE2
+            if (i + 16 <= dataSize && _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i))) == 0) {
+                i += 16;
+                continue;
+            }
+#else
+            uint64_t block;
+            if (i + 8 <= dataSize && (std::memcpy(&block, data + i, 8), (block & 0x8080808080808080ULL) == 0)) {
+                i += 8;
+                continue;
+            }
+#endif
+            i++;
+            continue;
+        }
+
         int codelength = utf8classify(static_cast<unsigned char>(data[i]));
         if (codelength == utf8highbyte || codelength == utf8fail)
             return false;
@@ -79,6 +142,7 @@ static bool valid_utf8(const char* data, std::size_t dataSize) {
             if (utf8classify(static_cast<unsigned char>(data[i])) != utf8highbyte)
                 return false;
         }
+        i++;
     }
     
     return true;
@@ -130,16 +194,44 @@ inline Tcl_Obj* MakeBaseSWObj(double d) {
 }
 
 
-inline Tcl_Obj* MakeBaseSWObj(const std::string &s) {
+// raw binary data, e.g. packed numeric arrays
+struct SWBytes {
+	const void *data;
+	std::size_t size;
+	SWBytes() : data(NULL), size(0) { }
+	SWBytes(const void *data, std::size_t size) : data(data), size(size) { }
+};
+
+inline Tcl_Obj* MakeBaseSWObj(const SWBytes &b) {
+	// create byte array object
+	return Tcl_NewByteArrayObj(reinterpret_cast<const unsigned char*>(b.data), b.size);
+}
+
+// string data in a foreign buffer, e.g. read from a file
+struct SWStringRef {
+	const char *data;
+	std::size_t size;
+	SWStringRef(const char *data, std::size_t size) : data(data), size(size) { }
+};
+
+inline Tcl_Obj* MakeBaseSWObj(const SWStringRef &s) {
     // create string object
 	// first check if it is UTF8 compatible
-	if (valid_utf8(s.c_str(), s.size())) {
-		return Tcl_NewStringObj(s.c_str(), s.size());
+	if (valid_utf8(s.data, s.size)) {
+		return Tcl_NewStringObj(s.data, s.size);
 	} else {
-		return Tcl_NewByteArrayObj(reinterpret_cast<const unsigned char*>(s.c_str()), s.size());
+		return Tcl_NewByteArrayObj(reinterpret_cast<const unsigned char*>(s.data), s.size);
 	}
 }
 
+inline Tcl_Obj* MakeBaseSWObj(const std::string &s) {
+	return MakeBaseSWObj(SWStringRef(s.c_str(), s.size()));
+}
+
+inline Tcl_Obj* MakeBaseSWObj(const char *s) {
+	return MakeBaseSWObj(SWStringRef(s, std::strlen(s)));
+}
+
 
 Tcl_Obj* MakeBaseSWObj(const SWList &o);
 
@@ -151,6 +243,11 @@ protected:
 public:
     SWObject() : ptr(NULL) { }
 
+    // wrap an existing object, e.g. an argument from the interpreter
+    explicit SWObject(Tcl_Obj *obj) : ptr(obj) {
+        if (ptr) Tcl_IncrRefCount(ptr);
+    }
+
     template <typename TObject> 
     SWObject(const TObject& obj) : ptr(obj.getObj()) {
         if (ptr) Tcl_IncrRefCount(ptr);
@@ -235,6 +332,46 @@ public:
         ensure_exists();
 		return ptr;
 	}
+
+	// read access to lists passed in as arguments
+	explicit SWList(Tcl_Obj *obj) : SWObject(obj) { }
+
+	size_t size() const {
+		int len;
+		if (Tcl_ListObjLength(NULL, getObj(), &len) != TCL_OK) {
+			throw std::runtime_error("Argument is not a valid list");
+		}
+		return len;
+	}
+
+	Tcl_Obj* at(size_t index) const {
+		Tcl_Obj *el = NULL;
+		Tcl_ListObjIndex(NULL, getObj(), index, &el);
+		if (!el) throw std::runtime_error("List index out of range");
+		return el;
+	}
+
+	std::string getString(size_t index) const {
+		int len;
+		const char *s = Tcl_GetStringFromObj(at(index), &len);
+		return std::string(s, len);
+	}
+
+	bool getLong(size_t index, long &value) const {
+		return Tcl_GetLongFromObj(NULL, at(index), &value) == TCL_OK;
+	}
+
+	SWList getList(size_t index) const {
+		return SWList(at(index));
+	}
+
+	double getDouble(size_t index) const {
+		double value;
+		if (Tcl_GetDoubleFromObj(NULL, at(index), &value) != TCL_OK) {
+			throw std::runtime_error("Expected floating point number, got \""+getString(index)+"\"");
+		}
+		return value;
+	}
 };
 
 inline Tcl_Obj* MakeBaseSWObj(const SWList &l) {
@@ -282,6 +419,275 @@ inline Tcl_Obj* MakeBaseSWObj(const SWDict &d) {
     return d.getObj();
 }
 
+// command prefix passed in from the interpreter, which is called with
+// additional arguments. An empty prefix is not called
+class SWCallback {
+	Tcl_Interp *interp;
+	SWObject prefix;
+public:
+	SWCallback() : interp(NULL) { }
+	SWCallback(Tcl_Interp *interp, Tcl_Obj *prefix) : interp(interp), prefix(prefix) { }
+
+	bool empty() const {
+		int len;
+		return !interp || Tcl_ListObjLength(NULL, prefix.getObj(), &len) != TCL_OK || len == 0;
+	}
+
+	// false if the command returned with break, errors are thrown
+	bool call(const SWObject& arg1, const SWObject& arg2) const {
+		if (empty()) return true;
+		Tcl_Obj *cmd = Tcl_DuplicateObj(prefix.getObj());
+		Tcl_IncrRefCount(cmd);
+		Tcl_ListObjAppendElement(NULL, cmd, arg1.getObj());
+		Tcl_ListObjAppendElement(NULL, cmd, arg2.getObj());
+		int code = Tcl_EvalObjEx(interp, cmd, 0);
+		Tcl_DecrRefCount(cmd);
+		if (code == TCL_ERROR) throw std::runtime_error(Tcl_GetStringResult(interp));
+		Tcl_ResetResult(interp);
+		return code != TCL_BREAK;
+	}
+};
+
+// elements of a list which are only created when accessed,
+// e.g. from a buffer of native values
+class SWLazySource {
+public:
+	virtual ~SWLazySource() { }
+	virtual std::size_t size() const = 0;
+	virtual SWObject element(std::size_t index) const = 0;
+};
+
+// The lazy list is a Tcl_ObjType which holds the source. Its string form is
+// generated when needed. hdfpp::llength, hdfpp::lindex and hdfpp::lrange read
+// the length and single elements from the source; Tcl 9 also queries them 
+// through the abstract list interface. The core list commands of Tcl 8.6 
+// convert the object to a list via the string, which is slower than building
+// the list directly, therefore lazy lists are only returned on 8.6 after 
+// "hdfpp::lazylists 1". Otherwise MakeLazyList returns an ordinary list.
+struct SWLazyRep {
+	std::size_t refcount;
+	SWLazySource *source;
+};
+
+inline SWLazyRep* SWLazyRepOf(Tcl_Obj *obj) {
+	return static_cast<SWLazyRep*>(obj->internalRep.twoPtrValue.ptr1);
+}
+
+inline void SWLazyFree(Tcl_Obj *obj) {
+	SWLazyRep *rep = SWLazyRepOf(obj);
+	if (--rep->refcount == 0) {
+		delete rep->source;
+		delete rep;
+	}
+}
+
+inline void SWLazyDup(Tcl_Obj *src, Tcl_Obj *dup) {
+	SWLazyRep *rep = SWLazyRepOf(src);
+	rep->refcount++;
+	dup->internalRep.twoPtrValue.ptr1 = rep;
+	dup->typePtr = src->typePtr;
+}
+
+inline void SWLazyUpdateString(Tcl_Obj *obj) {
+	// full conversion, same string as the equivalent list
+	SWLazySource *source = SWLazyRepOf(obj)->source;
+	Tcl_Obj *list = Tcl_NewListObj(0, NULL);
+	Tcl_IncrRefCount(list);
+	for (std::size_t i = 0; i < source->size(); i++) {
+		Tcl_ListObjAppendElement(NULL, list, source->element(i).getObj());
+	}
+	const char *str = Tcl_GetString(list);
+	std::size_t len = list->length;
+	obj->bytes = static_cast<char*>(Tcl_Alloc(len + 1));
+	std::copy(str, str + len + 1, obj->bytes);
+	obj->length = len;
+	Tcl_DecrRefCount(list);
+}
+
+#ifdef TCL_OBJTYPE_V2
+inline Tcl_Size SWLazyLength(Tcl_Obj *obj) {
+	return SWLazyRepOf(obj)->source->size();
+}
+
+inline int SWLazyIndex(Tcl_Interp *, Tcl_Obj *obj, Tcl_Size index, Tcl_Obj **elemObj) {
+	SWLazySource *source = SWLazyRepOf(obj)->source;
+	if (index < 0 || std::size_t(index) >= source->size()) {
+		*elemObj = NULL;
+	} else {
+		// a fresh object with zero refcount
+		*elemObj = Tcl_DuplicateObj(source->element(index).getObj());
+	}
+	return TCL_OK;
+}
+#endif
+
+inline const Tcl_ObjType* SWLazyType() {
+	static const Tcl_ObjType type = {
+		"swlazylist", SWLazyFree, SWLazyDup, SWLazyUpdateString, NULL,
+#ifdef TCL_OBJTYPE_V2
+		TCL_OBJTYPE_V2(SWLazyLength, SWLazyIndex, NULL, NULL, NULL, NULL, NULL, NULL)
+#endif
+	};
+	return &type;
+}
+
+inline SWLazySource* SWLazySourceOf(Tcl_Obj *obj) {
+	return obj->typePtr == SWLazyType() ? SWLazyRepOf(obj)->source : NULL;
+}
+
+// whether MakeLazyList returns lazy lists
+inline bool& SWLazyListEnabled() {
+#ifdef TCL_OBJTYPE_V2
+	static bool enabled = true;
+#else
+	static bool enabled = false;
+#endif
+	return enabled;
+}
+
+// takes ownership of the source
+inline SWObject MakeLazyList(SWLazySource *source) {
+	if (!SWLazyListEnabled()) {
+		SWList result;
+		for (std::size_t i = 0; i < source->size(); i++) {
+			result.push_back(source->element(i));
+		}
+		delete source;
+		return result;
+	}
+	Tcl_Obj *obj = Tcl_NewObj();
+	Tcl_InvalidateStringRep(obj);
+	SWLazyRep *rep = new SWLazyRep;
+	rep->refcount = 1;
+	rep->source = source;
+	obj->internalRep.twoPtrValue.ptr1 = rep;
+	obj->typePtr = SWLazyType();
+	return SWObject(obj);
+}
+
+// integer, end, or either followed by +N or -N, as in the core list commands
+inline int SWLazyGetIndex(Tcl_Interp *interp, Tcl_Obj *obj, long size, long &index) {
+	const char *str = Tcl_GetString(obj);
+	const char *op;
+	long base;
+	if (std::strncmp(str, "end", 3) == 0) {
+		base = size - 1;
+		op = str + 3;
+	} else {
+		if (Tcl_GetLongFromObj(NULL, obj, &index) == TCL_OK) return TCL_OK;
+		char *rest;
+		base = std::strtol(str, &rest, 10);
+		op = rest == str ? NULL : rest;
+	}
+	if (op && *op == '\0') {
+		index = base;
+		return TCL_OK;
+	}
+	if (op && (*op == '+' || *op == '-') && op[1] >= '0' && op[1] <= '9') {
+		char *rest;
+		long offset = std::strtol(op + 1, &rest, 10);
+		if (*rest == '\0') {
+			index = (*op == '+') ? base + offset : base - offset;
+			return TCL_OK;
+		}
+	}
+	Tcl_SetObjResult(interp, Tcl_ObjPrintf("bad index \"%s\": must be integer?[+-]integer? or end?[+-]integer?", str));
+	return TCL_ERROR;
+}
+
+inline int SWLazyLLengthCmd(ClientData, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+	if (objc != 2) {
+		Tcl_WrongNumArgs(interp, 1, objv, "list");
+		return TCL_ERROR;
+	}
+	SWLazySource *source = SWLazySourceOf(objv[1]);
+	if (source) {
+		Tcl_SetObjResult(interp, Tcl_NewWideIntObj(source->size()));
+		return TCL_OK;
+	}
+	int len;
+	if (Tcl_ListObjLength(interp, objv[1], &len) != TCL_OK) return TCL_ERROR;
+	Tcl_SetObjResult(interp, Tcl_NewIntObj(len));
+	return TCL_OK;
+}
+
+inline int SWLazyLIndexCmd(ClientData, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+	if (objc != 3) {
+		Tcl_WrongNumArgs(interp, 1, objv, "list index");
+		return TCL_ERROR;
+	}
+	SWLazySource *source = SWLazySourceOf(objv[1]);
+	if (!source) {
+		int len;
+		Tcl_Obj *el = NULL;
+		long index;
+		if (Tcl_ListObjLength(interp, objv[1], &len) != TCL_OK) return TCL_ERROR;
+		if (SWLazyGetIndex(interp, objv[2], len, index) != TCL_OK) return TCL_ERROR;
+		if (index >= 0 && index < len) Tcl_ListObjIndex(interp, objv[1], index, &el);
+		if (el) Tcl_SetObjResult(interp, el);
+		return TCL_OK;
+	}
+	long index;
+	if (SWLazyGetIndex(interp, objv[2], source->size(), index) != TCL_OK) return TCL_ERROR;
+	if (index >= 0 && std::size_t(index) < source->size()) {
+		Tcl_SetObjResult(interp, source->element(index).getObj());
+	}
+	return TCL_OK;
+}
+
+inline int SWLazyLRangeCmd(ClientData, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+	if (objc != 4) {
+		Tcl_WrongNumArgs(interp, 1, objv, "list first last");
+		return TCL_ERROR;
+	}
+	SWLazySource *source = SWLazySourceOf(objv[1]);
+	int len = 0;
+	if (source) {
+		len = source->size();
+	} else if (Tcl_ListObjLength(interp, objv[1], &len) != TCL_OK) {
+		return TCL_ERROR;
+	}
+	long first, last;
+	if (SWLazyGetIndex(interp, objv[2], len, first) != TCL_OK) return TCL_ERROR;
+	if (SWLazyGetIndex(interp, objv[3], len, last) != TCL_OK) return TCL_ERROR;
+	if (first < 0) first = 0;
+	if (last >= len) last = len - 1;
+	
+	Tcl_Obj *result = Tcl_NewListObj(0, NULL);
+	for (long i = first; i <= last; i++) {
+		if (source) {
+			Tcl_ListObjAppendElement(NULL, result, source->element(i).getObj());
+		} else {
+			Tcl_Obj *el;
+			Tcl_ListObjIndex(NULL, objv[1], i, &el);
+			Tcl_ListObjAppendElement(NULL, result, el);
+		}
+	}
+	Tcl_SetObjResult(interp, result);
+	return TCL_OK;
+}
+
+inline int SWLazyListsCmd(ClientData, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+	if (objc > 2) {
+		Tcl_WrongNumArgs(interp, 1, objv, "?enable?");
+		return TCL_ERROR;
+	}
+	if (objc == 2) {
+		int enable;
+		if (Tcl_GetBooleanFromObj(interp, objv[1], &enable) != TCL_OK) return TCL_ERROR;
+		SWLazyListEnabled() = enable != 0;
+	}
+	Tcl_SetObjResult(interp, Tcl_NewBooleanObj(SWLazyListEnabled()));
+	return TCL_OK;
+}
+
+inline void SWLazyList_Init(Tcl_Interp *interp) {
+	Tcl_CreateObjCommand(interp, "::hdfpp::lazylists", SWLazyListsCmd, NULL, NULL);
+	Tcl_CreateObjCommand(interp, "::hdfpp::llength", SWLazyLLengthCmd, NULL, NULL);
+	Tcl_CreateObjCommand(interp, "::hdfpp::lindex", SWLazyLIndexCmd, NULL, NULL);
+	Tcl_CreateObjCommand(interp, "::hdfpp::lrange", SWLazyLRangeCmd, NULL, NULL);
+}
+
 #endif
 #endif // SWIGTCL
 
@@ -300,6 +706,39 @@ inline Tcl_Obj* MakeBaseSWObj(const SWDict &d) {
 	$result =  $1.getObj();
 }   
 
+// sequences passed in from Python are wrapped without conversion
+%typemap(in) const SWList& (SWList temp) {
+	temp = SWList($input);
+	$1 = &temp;
+}
+
+%typecheck(SWIG_TYPECHECK_POINTER) const SWList& {
+	$1 = PySequence_Check($input);
+}
+
+// bytes passed in from Python, e.g. packed arrays or numpy's tobytes()
+%typemap(in) const SWBytes& (SWBytes temp) {
+	char *bytes;
+	Py_ssize_t len;
+	if (PyBytes_AsStringAndSize($input, &bytes, &len) < 0) SWIG_fail;
+	temp = SWBytes(bytes, len);
+	$1 = &temp;
+}
+
+%typecheck(SWIG_TYPECHECK_POINTER) const SWBytes& {
+	$1 = PyBytes_Check($input);
+}
+
+// callables passed in from Python, None for no callback
+%typemap(in) const SWCallback& (SWCallback temp) {
+	temp = SWCallback($input);
+	$1 = &temp;
+}
+
+%typecheck(SWIG_TYPECHECK_POINTER) const SWCallback& {
+	$1 = ($input == Py_None || PyCallable_Check($input));
+}
+
 
 %{
 #include "SWObject.hpp"
@@ -309,6 +748,7 @@ inline Tcl_Obj* MakeBaseSWObj(const SWDict &d) {
 // C++-compiler - Python version
 #include <Python.h>
 #include <string>
+#include <stdexcept>
 
 // create PyObject by overloaded functions
 class SWList;
@@ -354,11 +794,41 @@ inline PyObject* MakeBaseSWObj(float f) {
     return PyFloat_FromDouble(f);
 }
 
+// raw binary data, e.g. packed numeric arrays
+struct SWBytes {
+	const void *data;
+	std::size_t size;
+	SWBytes() : data(NULL), size(0) { }
+	SWBytes(const void *data, std::size_t size) : data(data), size(size) { }
+};
+
+inline PyObject* MakeBaseSWObj(const SWBytes &b) {
+	// create bytes object
+	return PyString_FromStringAndSize(reinterpret_cast<const char*>(b.data), b.size);
+}
+
+// string data in a foreign buffer, e.g. read from a file
+struct SWStringRef {
+	const char *data;
+	std::size_t size;
+	SWStringRef(const char *data, std::size_t size) : data(data), size(size) { }
+};
+
+inline PyObject* MakeBaseSWObj(const SWStringRef &s) {
+    // create string object
+    return PyString_FromStringAndSize(s.data, s.size);
+}
+
 inline PyObject* MakeBaseSWObj(const std::string &s) {
     // create string object
     return PyString_FromStringAndSize(s.c_str(), s.size());
 }
 
+inline PyObject* MakeBaseSWObj(const char *s) {
+    // create string object
+    return PyString_FromString(s);
+}
+
 
 PyObject* MakeBaseSWObj(const SWList &o);
 
@@ -370,6 +840,11 @@ protected:
 public:
     SWObject() : ptr(NULL) { }
 
+    // wrap an existing object, e.g. an argument from the interpreter
+    explicit SWObject(PyObject *obj) : ptr(obj) {
+        if (ptr) Py_INCREF(ptr);
+    }
+
     template <typename TObject> 
     SWObject(const TObject& obj) : ptr(obj.getObj()) {
         if (ptr) Py_INCREF(ptr);
@@ -453,6 +928,57 @@ public:
         ensure_exists();
 		return ptr;
 	}
+
+	// read access to sequences passed in as arguments
+	explicit SWList(PyObject *obj) : SWObject(obj) { }
+
+	size_t size() const {
+		Py_ssize_t len = PySequence_Size(getObj());
+		if (len < 0) {
+			PyErr_Clear();
+			throw std::runtime_error("Argument is not a sequence");
+		}
+		return len;
+	}
+
+	std::string getString(size_t index) const {
+		PyObject *el = PySequence_GetItem(getObj(), index);
+		if (!el) { PyErr_Clear(); throw std::runtime_error("List index out of range"); }
+		PyObject *str = PyObject_Str(el);
+		Py_DECREF(el);
+		std::string result(PyString_AsString(str));
+		Py_DECREF(str);
+		return result;
+	}
+
+	bool getLong(size_t index, long &value) const {
+		PyObject *el = PySequence_GetItem(getObj(), index);
+		if (!el) { PyErr_Clear(); return false; }
+		bool ok = PyLong_Check(el) || PyInt_Check(el);
+		if (ok) value = PyLong_AsLong(el);
+		Py_DECREF(el);
+		return ok;
+	}
+
+	SWList getList(size_t index) const {
+		PyObject *el = PySequence_GetItem(getObj(), index);
+		if (!el) { PyErr_Clear(); throw std::runtime_error("List index out of range"); }
+		SWList result(el);
+		Py_DECREF(el);
+		return result;
+	}
+
+	double getDouble(size_t index) const {
+		PyObject *el = PySequence_GetItem(getObj(), index);
+		if (!el) { PyErr_Clear(); throw std::runtime_error("List index out of range"); }
+		double value = PyFloat_AsDouble(el);
+		Py_DECREF(el);
+		if (PyErr_Occurred()) {
+			PyErr_Clear();
+			throw std::runtime_error("Expected floating point number");
+		}
+		return value;
+	}
 };
 
 inline PyObject* MakeBaseSWObj(const SWList &l) {
@@ -500,6 +1026,53 @@ inline PyObject* MakeBaseSWObj(const SWDict &d) {
     return d.getObj();
 }
 
+// callable passed in from Python, which is called with additional
+// arguments. None is not called
+class SWCallback {
+	SWObject callable;
+public:
+	SWCallback() { }
+	explicit SWCallback(PyObject *callable) : callable(callable) { }
+
+	bool empty() const {
+		return callable.getObj() == Py_None;
+	}
+
+	// false if the callable returned False, errors are thrown
+	bool call(const SWObject& arg1, const SWObject& arg2) const {
+		if (empty()) return true;
+		PyObject *result = PyObject_CallFunctionObjArgs(callable.getObj(), arg1.getObj(), arg2.getObj(), NULL);
+		if (!result) throw std::runtime_error("Error in callback");
+		bool proceed = (result != Py_False);
+		Py_DECREF(result);
+		return proceed;
+	}
+};
+
+// elements of a list which are only created when accessed,
+// e.g. from a buffer of native values
+class SWLazySource {
+public:
+	virtual ~SWLazySource() { }
+	virtual std::size_t size() const = 0;
+	virtual SWObject element(std::size_t index) const = 0;
+};
+
+// Python gets plain lists
+inline bool SWLazyListEnabled() {
+	return false;
+}
+
+// takes ownership of the source
+inline SWObject MakeLazyList(SWLazySource *source) {
+	SWList result;
+	for (std::size_t i = 0; i < source->size(); i++) {
+		result.push_back(source->element(i));
+	}
+	delete source;
+	return result;
+}
+
 
 #endif // C++
 #endif //SWIGPYTHON
@@ -0,0 +1,376 @@
+/*  columnwriter.hpp
+*
+*   (C) Copyright 2021 Physikalisch-Technische Bundesanstalt (PTB)
+*   Christian Gollwitzer
+*
+*   This file is part of BessyHDFViewer.
+*
+*   BessyHDFViewer is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   BessyHDFViewer is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with BessyHDFViewer.  If not, see <https://www.gnu.org/licenses/>.
+**
+*/
+
+/** Binary output of numeric columns for other analysis tools: NumPy .npy
+ * files and Arrow IPC streams. Both are written incrementally from buffers
+ * in native layout. Types are given by the names of packed arrays (int8 ..
+ * uint64, float32, float64).
+ **/
+
+#ifndef COLUMNWRITER_HPP
+#define COLUMNWRITER_HPP
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+static inline bool column_little_endian() {
+	unsigned short probe = 1;
+	return *reinterpret_cast<unsigned char*>(&probe) == 1;
+}
+
+// size in bytes, 0 for unsupported types
+static inline std::size_t column_elsize(const std::string& dtype) {
+	if (dtype == "int8" || dtype == "uint8") return 1;
+	if (dtype == "int16" || dtype == "uint16") return 2;
+	if (dtype == "int32" || dtype == "uint32" || dtype == "float32") return 4;
+	if (dtype == "int64" || dtype == "uint64" || dtype == "float64") return 8;
+	return 0;
+}
+
+// unbuffered output of large blocks, with errors as exceptions
+class column_file {
+	FILE *out;
+	std::string fname;
+public:
+	column_file(const std::string& fname) : out(NULL), fname(fname) {
+		out = fopen(fname.c_str(), "wb");
+		if (!out) throw std::runtime_error("Can't open " + fname + " for writing");
+	}
+
+	~column_file() {
+		if (out) fclose(out);
+	}
+
+	void put(const void *data, std::size_t len) {
+		if (len > 0 && fwrite(data, 1, len, out) != len) throw std::runtime_error("Error writing " + fname);
+	}
+
+	void close() {
+		if (!out) return;
+		int status = fclose(out);
+		out = NULL;
+		if (status != 0) throw std::runtime_error("Error writing " + fname);
+	}
+};
+
+// NumPy array file, format version 1.0. The data follows the header in C order
+class npy_writer {
+	column_file out;
+	std::size_t expected, written;
+public:
+	npy_writer(const std::string& fname, const std::string& dtype, const std::vector<unsigned long long>& shape) : out(fname), written(0) {
+		std::size_t elsize = column_elsize(dtype);
+		if (elsize == 0) throw std::runtime_error("Data type " + dtype + " can't be written to .npy");
+		// e.g. '<f8', byte order is irrelevant for single bytes
+		std::string descr = elsize == 1 ? "|" : column_little_endian() ? "<" : ">";
+		descr += dtype[0] == 'f' ? 'f' : dtype[0] == 'u' ? 'u' : 'i';
+		descr += char('0' + elsize);
+
+		std::string header = "{'descr': '" + descr + "', 'fortran_order': False, 'shape': (";
+		expected = elsize;
+		for (std::size_t d = 0; d < shape.size(); d++) {
+			char dim[24];
+			snprintf(dim, sizeof(dim), "%llu", shape[d]);
+			header += dim;
+			header += (shape.size() == 1 || d + 1 < shape.size()) ? "," : "";
+			if (d + 1 < shape.size()) header += ' ';
+			expected *= shape[d];
+		}
+		header += "), }";
+		// magic, version and length take 10 bytes, the data starts aligned to 64
+		while ((10 + header.size() + 1) % 64 != 0) header += ' ';
+		header += '\n';
+		std::size_t len = header.size();
+		unsigned char preamble[10] = { 0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0,
+			static_cast<unsigned char>(len & 0xFF), static_cast<unsigned char>(len >> 8) };
+		out.put(preamble, 10);
+		out.put(header.data(), len);
+	}
+
+	void write(const void *data, std::size_t len) {
+		out.put(data, len);
+		written += len;
+	}
+
+	void close() {
+		out.close();
+		if (written != expected) throw std::runtime_error("Incomplete data in .npy file");
+	}
+};
+
+// Minimal FlatBuffers encoder for the Arrow metadata. Objects are laid out
+// front to back, a table is followed by the objects it refers to, such that
+// all offsets point forward. Scalars are little endian and aligned to their size
+class fb_builder {
+	std::vector<unsigned char> buf;
+
+	void put(unsigned long long v, std::size_t size) {
+		for (std::size_t i = 0; i < size; i++) buf.push_back((v >> (8*i)) & 0xFF);
+	}
+
+	void poke(std::size_t pos, unsigned long long v, std::size_t size) {
+		for (std::size_t i = 0; i < size; i++) buf[pos + i] = (v >> (8*i)) & 0xFF;
+	}
+
+	// pad such that the position plus shift is a multiple of align
+	void pad(std::size_t align, std::size_t shift = 0) {
+		while ((buf.size() + shift) % align != 0) buf.push_back(0);
+	}
+
+public:
+	struct field {
+		int id;
+		std::size_t size;
+		unsigned long long value;
+		bool ref; // offset to an object, which is linked later
+	};
+
+	fb_builder() {
+		// offset to the root table
+		put(0, 4);
+	}
+
+	const std::vector<unsigned char>& data() const {
+		return buf;
+	}
+
+	// the object at target becomes the value of the offset at ref
+	void link(std::size_t ref, std::size_t target) {
+		poke(ref, target - ref, 4);
+	}
+
+	void root(std::size_t table) {
+		link(0, table);
+	}
+
+	// vtable and table, returns the position of the table and
+	// the positions of the reference fields in refs, in order
+	std::size_t table(const std::vector<field>& fields, std::vector<std::size_t>& refs) {
+		int nslots = 0;
+		for (std::size_t i = 0; i < fields.size(); i++) nslots = std::max(nslots, fields[i].id + 1);
+		// inline layout, larger fields first, the table itself starts 8-aligned
+		std::vector<std::size_t> offset(fields.size());
+		std::size_t end = 4;
+		for (std::size_t size = 8; size > 0; size /= 2) {
+			for (std::size_t i = 0; i < fields.size(); i++) {
+				if (fields[i].size != size) continue;
+				end = (end + size - 1) / size * size;
+				offset[i] = end;
+				end += size;
+			}
+		}
+		pad(2);
+		std::size_t vtable = buf.size();
+		put(4 + 2*nslots, 2);
+		put(end, 2);
+		std::vector<std::size_t> slots(nslots, 0);
+		for (std::size_t i = 0; i < fields.size(); i++) slots[fields[i].id] = offset[i];
+		for (int s = 0; s < nslots; s++) put(slots[s], 2);
+		pad(8);
+		std::size_t table = buf.size();
+		put(table - vtable, 4);
+		buf.resize(table + end, 0);
+		refs.clear();
+		for (std::size_t i = 0; i < fields.size(); i++) {
+			poke(table + offset[i], fields[i].value, fields[i].size);
+			if (fields[i].ref) refs.push_back(table + offset[i]);
+		}
+		return table;
+	}
+
+	std::size_t string(const std::string& s) {
+		pad(4);
+		std::size_t pos = buf.size();
+		put(s.size(), 4);
+		buf.insert(buf.end(), s.begin(), s.end());
+		buf.push_back(0);
+		return pos;
+	}
+
+	// vector of n offsets, returns their positions in refs
+	std::size_t refvector(std::size_t n, std::vector<std::size_t>& refs) {
+		pad(4);
+		std::size_t pos = buf.size();
+		put(n, 4);
+		refs.clear();
+		for (std::size_t i = 0; i < n; i++) {
+			refs.push_back(buf.size());
+			put(0, 4);
+		}
+		return pos;
+	}
+
+	// vector of structs of two longs, like FieldNode and Buffer
+	std::size_t pairvector(const std::vector<unsigned long long>& values) {
+		pad(8, 4);
+		std::size_t pos = buf.size();
+		put(values.size() / 2, 4);
+		for (std::size_t i = 0; i < values.size(); i++) put(values[i], 8);
+		return pos;
+	}
+};
+
+// Arrow IPC stream of record batches with non-nullable numeric columns
+class arrow_writer {
+	column_file out;
+	std::vector<std::string> names;
+	std::vector<std::string> dtypes;
+
+	// Message.fbs, Schema.fbs
+	enum { version_v5 = 4, header_schema = 1, header_recordbatch = 3 };
+	enum { type_int = 2, type_float = 3 };
+
+	static std::size_t padded(std::size_t n) {
+		return (n + 7) & ~std::size_t(7);
+	}
+
+	// continuation marker, length and metadata, padded to 8 bytes
+	void message(const fb_builder& fb) {
+		const std::vector<unsigned char>& meta = fb.data();
+		std::size_t len = padded(meta.size());
+		unsigned char prefix[8] = { 0xFF, 0xFF, 0xFF, 0xFF,
+			static_cast<unsigned char>(len & 0xFF), static_cast<unsigned char>((len >> 8) & 0xFF),
+			static_cast<unsigned char>((len >> 16) & 0xFF), static_cast<unsigned char>((len >> 24) & 0xFF) };
+		static const unsigned char zeros[8] = { 0 };
+		out.put(prefix, 8);
+		out.put(&meta[0], meta.size());
+		out.put(zeros, len - meta.size());
+	}
+
+	// Message table with the header table written by the functor
+	template <typename F>
+	static void message_table(fb_builder& fb, int headertype, unsigned long long bodylength, F header) {
+		std::vector<fb_builder::field> fields = {
+			{ 0, 2, version_v5, false },
+			{ 1, 1, static_cast<unsigned long long>(headertype), false },
+			{ 2, 4, 0, true },
+			{ 3, 8, bodylength, false }
+		};
+		std::vector<std::size_t> refs;
+		fb.root(fb.table(fields, refs));
+		std::size_t ref = refs[0];
+		fb.link(ref, header());
+	}
+
+	void schema() {
+		fb_builder fb;
+		message_table(fb, header_schema, 0, [&]() {
+			std::vector<std::size_t> refs;
+			std::vector<fb_builder::field> schemafields = {
+				{ 0, 2, column_little_endian() ? 0ULL : 1ULL, false },
+				{ 1, 4, 0, true }
+			};
+			std::size_t schema = fb.table(schemafields, refs);
+			std::size_t ref = refs[0];
+			std::vector<std::size_t> fieldrefs;
+			fb.link(ref, fb.refvector(names.size(), fieldrefs));
+			for (std::size_t c = 0; c < names.size(); c++) {
+				bool isfloat = dtypes[c][0] == 'f';
+				std::vector<fb_builder::field> fieldfields = {
+					{ 0, 4, 0, true },  // name
+					{ 1, 1, 0, false }, // not nullable
+					{ 2, 1, static_cast<unsigned long long>(isfloat ? type_float : type_int), false },
+					{ 3, 4, 0, true },  // type
+					{ 5, 4, 0, true }   // children
+				};
+				fb.link(fieldrefs[c], fb.table(fieldfields, refs));
+				std::vector<std::size_t> subrefs(refs);
+				fb.link(subrefs[0], fb.string(names[c]));
+				std::size_t elsize = column_elsize(dtypes[c]);
+				std::vector<fb_builder::field> typefields;
+				if (isfloat) {
+					// precision SINGLE or DOUBLE
+					typefields.push_back({ 0, 2, elsize == 4 ? 1ULL : 2ULL, false });
+				} else {
+					typefields.push_back({ 0, 4, 8*elsize, false });
+					typefields.push_back({ 1, 1, dtypes[c][0] == 'u' ? 0ULL : 1ULL, false });
+				}
+				std::vector<std::size_t> norefs;
+				fb.link(subrefs[1], fb.table(typefields, norefs));
+				fb.link(subrefs[2], fb.refvector(0, norefs));
+			}
+			return schema;
+		});
+		message(fb);
+	}
+
+public:
+	arrow_writer(const std::string& fname, const std::vector<std::string>& names, const std::vector<std::string>& dtypes) : out(fname), names(names), dtypes(dtypes) {
+		for (std::size_t c = 0; c < dtypes.size(); c++) {
+			if (column_elsize(dtypes[c]) == 0) throw std::runtime_error("Data type " + dtypes[c] + " can't be written to Arrow");
+		}
+		schema();
+	}
+
+	// one record batch of nrows values per column, in native layout
+	void batch(std::size_t nrows, const std::vector<const void*>& columns) {
+		// validity buffers are empty, because there are no nulls
+		std::vector<unsigned long long> nodes, buffers;
+		std::size_t body = 0;
+		for (std::size_t c = 0; c < columns.size(); c++) {
+			std::size_t len = nrows * column_elsize(dtypes[c]);
+			nodes.push_back(nrows);
+			nodes.push_back(0);
+			buffers.push_back(body);
+			buffers.push_back(0);
+			buffers.push_back(body);
+			buffers.push_back(len);
+			body += padded(len);
+		}
+
+		fb_builder fb;
+		message_table(fb, header_recordbatch, body, [&]() {
+			std::vector<std::size_t> refs;
+			std::vector<fb_builder::field> batchfields = {
+				{ 0, 8, nrows, false },
+				{ 1, 4, 0, true },
+				{ 2, 4, 0, true }
+			};
+			std::size_t batch = fb.table(batchfields, refs);
+			std::vector<std::size_t> vrefs(refs);
+			fb.link(vrefs[0], fb.pairvector(nodes));
+			fb.link(vrefs[1], fb.pairvector(buffers));
+			return batch;
+		});
+		message(fb);
+
+		static const unsigned char zeros[8] = { 0 };
+		for (std::size_t c = 0; c < columns.size(); c++) {
+			std::size_t len = nrows * column_elsize(dtypes[c]);
+			out.put(columns[c], len);
+			out.put(zeros, padded(len) - len);
+		}
+	}
+
+	// end of stream marker
+	void close() {
+		static const unsigned char eos[8] = { 0xFF, 0xFF, 0xFF, 0xFF, 0, 0, 0, 0 };
+		out.put(eos, 8);
+		out.close();
+	}
+};
+
+#endif // COLUMNWRITER_HPP
@@ -0,0 +1,361 @@
+/*  hdfbench.cpp
+*
+*   (C) Copyright 2021 Physikalisch-Technische Bundesanstalt (PTB)
+*   Christian Gollwitzer
+*
+*   This file is part of BessyHDFViewer.
+*
+*   BessyHDFViewer is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   BessyHDFViewer is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with BessyHDFViewer.  If not, see <https://www.gnu.org/licenses/>.
+**
+*/
+
+/** Standalone benchmark: writes synthetic HDF4/HDF5 files and times
+ * the readers and the marshalling into interpreter objects.
+ * Built with "make bench", options are passed in BENCHFLAGS, e.g.
+ *   make bench BENCHFLAGS="-objects 1000 -length 10000 -compress 6"
+ * Each result is printed as one JSON object per line.
+ * With -latency, every read of the blockcache driver is delayed by
+ * that many microseconds, to compare it to uncached reads from a network file system.
+ **/
+
+#include "hdfpp.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "mfhdf.h"
+
+#ifdef HAVE_HDF5
+#include "hdf5.h"
+#endif
+
+using namespace std;
+
+struct bench_config {
+	long objects;  // number of groups (HDF5) or SDS (HDF4)
+	long attrs;    // attributes per SDS (HDF4) or group (HDF5)
+	long length;   // elements per data set
+	long width;    // members of the HDF5 compound, 1 for plain double
+	long chunk;    // chunk length, 0 for contiguous storage
+	long compress; // deflate level, 0 for none
+	long repeat;   // timing runs, the fastest one is reported
+	long latency;  // simulated latency per read in microseconds, 0 to skip the driver benchmark
+	string dir;    // where the fixtures are written
+	bool hdf4;
+	bool hdf5;
+};
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "Usage: %s ?-objects n? ?-attrs n? ?-length n? ?-width n? ?-chunk n? ?-compress level? "
+		"?-repeat n? ?-latency us? ?-dir path? ?-hdf4 0|1? ?-hdf5 0|1?\n", argv0);
+	exit(1);
+}
+
+static bench_config parse_args(int argc, char **argv) {
+	bench_config cfg;
+	cfg.objects = 100;
+	cfg.attrs = 10;
+	cfg.length = 10000;
+	cfg.width = 4;
+	cfg.chunk = 0;
+	cfg.compress = 0;
+	cfg.repeat = 3;
+	cfg.latency = 0;
+	cfg.dir = ".";
+	cfg.hdf4 = true;
+	cfg.hdf5 = true;
+
+	for (int i = 1; i < argc; i += 2) {
+		if (i+1 >= argc) usage(argv[0]);
+		string opt = argv[i];
+		const char *value = argv[i+1];
+		if (opt == "-dir") { cfg.dir = value; continue; }
+		char *end;
+		long v = strtol(value, &end, 10);
+		if (*end || v < 0) usage(argv[0]);
+		if (opt == "-objects") cfg.objects = v;
+		else if (opt == "-attrs") cfg.attrs = v;
+		else if (opt == "-length") cfg.length = v;
+		else if (opt == "-width") cfg.width = v;
+		else if (opt == "-chunk") cfg.chunk = v;
+		else if (opt == "-compress") cfg.compress = v;
+		else if (opt == "-repeat") cfg.repeat = v;
+		else if (opt == "-latency") cfg.latency = v;
+		else if (opt == "-hdf4") cfg.hdf4 = v != 0;
+		else if (opt == "-hdf5") cfg.hdf5 = v != 0;
+		else usage(argv[0]);
+	}
+	if (cfg.width < 1) cfg.width = 1;
+	if (cfg.repeat < 1) cfg.repeat = 1;
+	if (cfg.chunk > cfg.length) cfg.chunk = cfg.length;
+	return cfg;
+}
+
+// deterministic, non-trivial test values, which do not compress too well
+static void fill_values(vector<double>& buf, long seed) {
+	unsigned long long state = 0x9E3779B97F4A7C15ULL * (seed + 1);
+	for (size_t i = 0; i < buf.size(); i++) {
+		state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+		buf[i] = static_cast<double>(i) + static_cast<double>(state >> 40) / (1 << 24);
+	}
+}
+
+static void write_hdf4(const bench_config& cfg, const string& fname) {
+	int32 sd_id = SDstart(fname.c_str(), DFACC_CREATE);
+	if (sd_id == FAIL) throw runtime_error("Can't create " + fname);
+
+	vector<double> buf(cfg.length);
+	for (long obj = 0; obj < cfg.objects; obj++) {
+		char name[32];
+		snprintf(name, sizeof(name), "sds%ld", obj);
+		int32 dims[1] = { static_cast<int32>(cfg.length) };
+		int32 sds_id = SDcreate(sd_id, name, DFNT_FLOAT64, 1, dims);
+		if (sds_id == FAIL) throw runtime_error(string("Can't create SDS ") + name);
+
+		if (cfg.chunk > 0) {
+			HDF_CHUNK_DEF cdef;
+			memset(&cdef, 0, sizeof(cdef));
+			int32 flags = HDF_CHUNK;
+			if (cfg.compress > 0) {
+				cdef.comp.chunk_lengths[0] = cfg.chunk;
+				cdef.comp.comp_type = COMP_CODE_DEFLATE;
+				cdef.comp.cinfo.deflate.level = cfg.compress;
+				flags |= HDF_COMP;
+			} else {
+				cdef.chunk_lengths[0] = cfg.chunk;
+			}
+			SDsetchunk(sds_id, cdef, flags);
+		} else if (cfg.compress > 0) {
+			comp_info cinfo;
+			cinfo.deflate.level = cfg.compress;
+			SDsetcompress(sds_id, COMP_CODE_DEFLATE, &cinfo);
+		}
+
+		for (long a = 0; a < cfg.attrs; a++) {
+			char aname[32];
+			snprintf(aname, sizeof(aname), "attr%ld", a);
+			if (a % 2) {
+				const char *unit = "mm";
+				SDsetattr(sds_id, aname, DFNT_CHAR8, strlen(unit), unit);
+			} else {
+				double value = obj + 0.5*a;
+				SDsetattr(sds_id, aname, DFNT_FLOAT64, 1, &value);
+			}
+		}
+
+		fill_values(buf, obj);
+		int32 start[1] = { 0 };
+		if (cfg.length > 0 && SDwritedata(sds_id, start, NULL, dims, &buf[0]) == FAIL) {
+			SDendaccess(sds_id);
+			throw runtime_error(string("Can't write SDS ") + name);
+		}
+		SDendaccess(sds_id);
+	}
+	SDend(sd_id);
+}
+
+#ifdef HAVE_HDF5
+static void write_hdf5(const bench_config& cfg, const string& fname) {
+	hid_t file = H5Fcreate(fname.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+	if (file < 0) throw runtime_error("Can't create " + fname);
+
+	// compound of width doubles, or a plain double for width 1
+	hid_t memtype;
+	if (cfg.width > 1) {
+		memtype = H5Tcreate(H5T_COMPOUND, cfg.width * sizeof(double));
+		for (long m = 0; m < cfg.width; m++) {
+			char mname[32];
+			snprintf(mname, sizeof(mname), "col%ld", m);
+			H5Tinsert(memtype, mname, m * sizeof(double), H5T_NATIVE_DOUBLE);
+		}
+	} else {
+		memtype = H5Tcopy(H5T_NATIVE_DOUBLE);
+	}
+
+	hsize_t dims[1] = { static_cast<hsize_t>(cfg.length) };
+	hid_t space = H5Screate_simple(1, dims, NULL);
+	hid_t scalar = H5Screate(H5S_SCALAR);
+	hid_t strtype = H5Tcopy(H5T_C_S1);
+	H5Tset_size(strtype, 3);
+
+	hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+	if (cfg.chunk > 0 || cfg.compress > 0) {
+		hsize_t chunk[1] = { static_cast<hsize_t>(cfg.chunk > 0 ? cfg.chunk : cfg.length) };
+		if (chunk[0] > 0) {
+			H5Pset_chunk(dcpl, 1, chunk);
+			if (cfg.compress > 0) H5Pset_deflate(dcpl, cfg.compress);
+		}
+	}
+
+	vector<double> buf(cfg.length * cfg.width);
+	for (long obj = 0; obj < cfg.objects; obj++) {
+		char gname[32];
+		snprintf(gname, sizeof(gname), "g%ld", obj);
+		hid_t group = H5Gcreate2(file, gname, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+		hid_t dset = H5Dcreate2(group, "data", memtype, space, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+		if (group < 0 || dset < 0) throw runtime_error(string("Can't create ") + gname + "/data");
+
+		for (long a = 0; a < cfg.attrs; a++) {
+			char aname[32];
+			snprintf(aname, sizeof(aname), "attr%ld", a);
+			hid_t attr;
+			if (a % 2) {
+				attr = H5Acreate2(group, aname, strtype, scalar, H5P_DEFAULT, H5P_DEFAULT);
+				H5Awrite(attr, strtype, "mm");
+			} else {
+				double value = obj + 0.5*a;
+				attr = H5Acreate2(group, aname, H5T_NATIVE_DOUBLE, scalar, H5P_DEFAULT, H5P_DEFAULT);
+				H5Awrite(attr, H5T_NATIVE_DOUBLE, &value);
+			}
+			H5Aclose(attr);
+		}
+
+		fill_values(buf, obj);
+		if (cfg.length > 0) H5Dwrite(dset, memtype, H5S_ALL, H5S_ALL, H5P_DEFAULT, &buf[0]);
+		H5Dclose(dset);
+		H5Gclose(group);
+	}
+
+	H5Pclose(dcpl);
+	H5Tclose(strtype);
+	H5Sclose(scalar);
+	H5Sclose(space);
+	H5Tclose(memtype);
+	H5Fclose(file);
+}
+#endif
+
+static double now() {
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// run the body repeat times and report the fastest run
+template <typename F>
+static void bench(const bench_config& cfg, const char *name, double objects, double bytes, F body) {
+	double best = -1;
+	for (long r = 0; r < cfg.repeat; r++) {
+		double t0 = now();
+		// the result is released after stopping the clock
+		SWObject result = body();
+		double t = now() - t0;
+		if (best < 0 || t < best) best = t;
+	}
+	printf("{\"bench\":\"%s\",\"objects\":%.0f,\"bytes\":%.0f,\"seconds\":%.6f,\"objects_per_s\":%.1f,\"mb_per_s\":%.2f}\n",
+		name, objects, bytes, best, best > 0 ? objects / best : 0.0, best > 0 ? bytes / best / 1e6 : 0.0);
+	fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+	bench_config cfg = parse_args(argc, argv);
+	// initializes the Tcl object system, no interpreter is needed
+	Tcl_FindExecutable(argv[0]);
+
+	printf("{\"config\":{\"objects\":%ld,\"attrs\":%ld,\"length\":%ld,\"width\":%ld,\"chunk\":%ld,\"compress\":%ld,\"repeat\":%ld,\"latency\":%ld}}\n",
+		cfg.objects, cfg.attrs, cfg.length, cfg.width, cfg.chunk, cfg.compress, cfg.repeat, cfg.latency);
+
+	try {
+		if (cfg.hdf4) {
+			string fname = cfg.dir + "/bench.hdf";
+			double t0 = now();
+			write_hdf4(cfg, fname);
+			fprintf(stderr, "Wrote %s in %.2fs\n", fname.c_str(), now() - t0);
+
+			// SDS plus their attributes
+			double objects = cfg.objects * (1.0 + cfg.attrs);
+			double bytes = 8.0 * cfg.objects * cfg.length;
+			bench(cfg, "hdf4_dump", objects, bytes, [&]() {
+				HDFpp h(fname.c_str());
+				return h.dump();
+			});
+			bench(cfg, "hdf4_readdata", cfg.objects, bytes, [&]() {
+				HDFpp h(fname.c_str());
+				SWList all;
+				for (size_t i = 0; i < h.get_num_datasets(); i++) all.push_back(h.readdata(i));
+				return SWObject(all);
+			});
+		}
+
+#ifdef HAVE_HDF5
+		if (cfg.hdf5) {
+			string fname = cfg.dir + "/bench.h5";
+			double t0 = now();
+			write_hdf5(cfg, fname);
+			fprintf(stderr, "Wrote %s in %.2fs\n", fname.c_str(), now() - t0);
+
+			// groups, data sets and attributes
+			double objects = cfg.objects * (2.0 + cfg.attrs);
+			double bytes = 8.0 * cfg.objects * cfg.length * cfg.width;
+			bench(cfg, "hdf5_dump", objects, bytes, [&]() {
+				H5pp h(fname.c_str());
+				return h.dump();
+			});
+			bench(cfg, "hdf5_dump_meta", objects - cfg.objects, 0, [&]() {
+				// groups and their attributes, without the data sets
+				H5pp h(fname.c_str());
+				return h.dump(2);
+			});
+
+			if (cfg.latency > 0) {
+				// the same reads through the blockcache driver with a simulated
+				// network latency, once passed through and once cached
+				blockcache_latency(cfg.latency * 1e-6);
+				const char *names[][2] = {
+					{ "hdf5_dump_uncached", "hdf5_dump_meta_uncached" },
+					{ "hdf5_dump_blockcache", "hdf5_dump_meta_blockcache" }
+				};
+				for (int cached = 0; cached < 2; cached++) {
+					blockcache_config(65536, cached ? 256 : 0);
+					bench(cfg, names[cached][0], objects, bytes, [&]() {
+						H5pp h(fname.c_str(), "blockcache");
+						return h.dump();
+					});
+					bench(cfg, names[cached][1], objects - cfg.objects, 0, [&]() {
+						H5pp h(fname.c_str(), "blockcache");
+						return h.dump(2);
+					});
+				}
+				blockcache_latency(0);
+			}
+		}
+#endif
+
+		// marshalling alone: the same amount of values as the data sets
+		// and the same number of keys as the attributes
+		size_t nvalues = cfg.objects * cfg.length * cfg.width;
+		bench(cfg, "marshal_list", nvalues, 8.0 * nvalues, [&]() {
+			SWList list;
+			for (size_t i = 0; i < nvalues; i++) list.push_back(static_cast<double>(i));
+			return SWObject(list);
+		});
+
+		size_t nkeys = cfg.objects * cfg.attrs;
+		bench(cfg, "marshal_dict", nkeys, 8.0 * nkeys, [&]() {
+			SWDict dict;
+			for (size_t i = 0; i < nkeys; i++) {
+				char key[32];
+				snprintf(key, sizeof(key), "attr%zu", i);
+				dict.insert(key, static_cast<double>(i));
+			}
+			return SWObject(dict);
+		});
+	} catch (const std::exception& e) {
+		fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
+	return 0;
+}
@@ -24,498 +24,2457 @@
  **/
 
 #include "hdfpp.hpp"
+#include "kernels.hpp"
+#include "jsonwriter.hpp"
+#include "columnwriter.hpp"
+#include "xxhash64.hpp"
 //#include <iostream>
+#include <unordered_map>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <memory>
+#include <cctype>
+#include <cstring>
+#include <map>
+#include <functional>
+#include <cstdio>
+#include <cerrno>
+#include <sys/stat.h>
+#include <thread>
+#include <chrono>
+#include <list>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <fcntl.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#endif
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
 
 #include "mfhdf.h"
 
 #ifdef HAVE_HDF5
 #include "hdf5.h"
+// since 1.12.1, the interface for file drivers is in a separate header
+#if defined(__has_include)
+#if __has_include("H5FDdevelop.h")
+#include "H5FDdevelop.h"
+#endif
+#endif
+// direct chunk writes are in the high level library before 1.10.3
+#if !H5_VERSION_GE(1, 10, 3)
+#include "hdf5_hl.h"
+#define H5Dwrite_chunk H5DOwrite_chunk
+#endif
+#include <zlib.h>
 #endif
 
 using namespace std;
 
-HDFpp::HDFpp(const char *fname) : hdf_id(0) {
-    hdf_id = SDstart(fname, DFACC_READ);
-    if (hdf_id==FAIL) STHROW("Can't open "<<fname);
-    int32 num_datasets; int32 num_global_attrs;
-    
-    if (SDfileinfo(hdf_id, &num_datasets, &num_global_attrs) == FAIL) {
-        STHROW("Error reading file information for "<<fname);
-    }
-
-    ndatasets = num_datasets;
-    nglobal_attrs = num_global_attrs;
+// Packed form of numeric arrays: the values in native binary layout
+// together with the data type and the shape. In Tcl, the data can be 
+// unpacked with binary scan, e.g. "binary scan $data q* values" for float64
+static SWDict make_packed(const char *dtype, const vector<long>& shape, const void *data, size_t bytes) {
+	SWDict result;
+	result.insert("dtype", dtype);
+	result.insert("shape", SWList(shape));
+	result.insert("data", SWBytes(data, bytes));
+	return result;
 }
 
-HDFpp::~HDFpp() {
-    close();
+template <typename T>
+static SWDict make_packed(const char *dtype, const vector<long>& shape, const vector<T>& buf) {
+	return make_packed(dtype, shape, buf.empty() ? NULL : &buf[0], buf.size()*sizeof(T));
 }
 
-void HDFpp::close() {
-    SDend(hdf_id);
-}
+// counters of the handle which is currently reading, NULL if profiling is off.
+// Thread local, because cursors may read ahead in another thread
+static thread_local perf_counters *perf_active = NULL;
 
-// ensure that SDendaccess is called for every possible exit - grrr
-class sds_release {
-	int32 id;
+#define PERF_COUNT(counter, n) { if (perf_active) perf_active->counter += (n); }
+
+// activates the counters of a handle for the duration of a call
+class perf_scope {
+	perf_counters *saved;
 public:
-	sds_release(int32 id) : id(id) { }
-	~sds_release() {
-		SDendaccess(id);
+	perf_scope(perf_counters& counters) : saved(perf_active) {
+		perf_active = counters.enabled ? &counters : NULL;
 	}
+	~perf_scope() { perf_active = saved; }
 };
 
+// adds the time until the end of the scope to one of the timers
+class perf_timer {
+	double perf_counters::*timer;
+	chrono::steady_clock::time_point start;
+public:
+	perf_timer(double perf_counters::*timer) : timer(perf_active ? timer : NULL) {
+		if (this->timer) start = chrono::steady_clock::now();
+	}
+	~perf_timer() { stop(); }
+	void stop() {
+		if (timer && perf_active) {
+			perf_active->*timer += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		}
+		timer = NULL;
+	}
+};
 
+static SWDict perfstats_internal(perf_counters& perf, const string& action) {
+	if (action != "" && action != "reset") STHROW("Unknown action "<<action<<", expected reset");
+	SWDict result;
+	result.insert("enabled", perf.enabled);
+	result.insert("objects", perf.objects);
+	result.insert("attributes", perf.attributes);
+	result.insert("bytes", perf.bytes);
+	result.insert("allocations", perf.allocations);
+	result.insert("created", perf.created);
+	result.insert("time_io", perf.t_io);
+	result.insert("time_decode", perf.t_decode);
+	result.insert("time_marshal", perf.t_marshal);
+	if (action == "reset") perf.reset();
+	return result;
+}
 
-string HDFpp::getname(size_t index) {
-	if (index>=ndatasets) STHROW("Only "<<ndatasets<<" data sets available, requested nr "<<index);
-    int32 sds_id;
-
-    if ((sds_id=SDselect(hdf_id, index))==FAIL) {
-        STHROW("Can't select data set nr. "<<index);
-    }
-    
-    sds_release srelease(sds_id);
+// sequential access to a data set (or a member of a compound data set)
+// as double values, independent of the file format. 
+class column_reader {
+public:
+	virtual ~column_reader() { }
+	// total number of values
+	virtual size_t size() const = 0;
+	// read values [start, start+count) into out
+	virtual void read(size_t start, size_t count, double *out) = 0;
+};
 
-	uint16 nlen;
-	if (SDgetnamelen(sds_id, &nlen)==FAIL) {
-        STHROW("Error getting name length for data set "<<index);
+// number of values transferred per read during streaming operations
+static const size_t streamblock = 65536;
+
+// iterate over the values [first, first+n) block by block. 
+// The functor is called with the index of the first value in the block, 
+// the x and y values and the block length. Without an x reader, 
+// the x values are the indices
+template <typename F>
+static void stream_blocks(column_reader& yreader, column_reader* xreader, size_t first, size_t n, F f) {
+	vector<double> ybuf(streamblock);
+	vector<double> xbuf(streamblock);
+	for (size_t start = first; start < first + n; start += streamblock) {
+		size_t count = min(streamblock, first + n - start);
+		yreader.read(start, count, &ybuf[0]);
+		if (xreader) {
+			xreader -> read(start, count, &xbuf[0]);
+		} else {
+			for (size_t i = 0; i < count; i++) xbuf[i] = start + i;
+		}
+		f(start, &xbuf[0], &ybuf[0], count);
 	}
+}
 
-	vector <char> sds_name(nlen+1);
-    int32 rank; int32 dimsizes[MAX_VAR_DIMS]; int32 data_type; int32 num_attrs;
-
-    if (SDgetinfo(sds_id, &(sds_name[0]), &rank, dimsizes, &data_type, &num_attrs)==FAIL) {
-        STHROW("Error getting information for data set "<<index);
-    }
-	
-	return string(&(sds_name[0]), nlen);
+// bucket index range [0, nbuckets) maps to [first, first+n)
+static inline size_t bucket_start(size_t b, size_t nbuckets, size_t first, size_t n) {
+	return first + (static_cast<unsigned long long>(b) * n) / nbuckets;
 }
 
+static void eval_index_range(size_t size, long first, long last, size_t& start, size_t& n) {
+	// inclusive range like lrange, last<0 means up to the end
+	if (last < 0 || size_t(last) >= size) last = long(size) - 1;
+	if (first < 0) first = 0;
+	if (size == 0 || first > last) {
+		start = 0; n = 0;
+		return;
+	}
+	start = first;
+	n = last - first + 1;
+}
 
-static SWList readdata4_internal(int32 sds_id, int32 rank, int32 *dimsizes, int32 data_type, int32 index) {
-    if (rank != 1) 
-        STHROW("Data set has rank "<<rank<<", expected 1d array.");
+static SWDict decimate_minmax(column_reader& yreader, column_reader* xreader, size_t nbuckets, size_t first, size_t n) {
+	// min/max envelope, x is the center of the bucket
+	const double inf = numeric_limits<double>::infinity();
+	const double nan = numeric_limits<double>::quiet_NaN();
+	if (nbuckets > n) nbuckets = n;
 
-    size_t nelements = dimsizes[0];
+	vector<double> bmin(nbuckets, inf), bmax(nbuckets, -inf);
+	vector<double> bxfirst(nbuckets, nan), bxlast(nbuckets, nan);
+	
+	size_t b = 0;
+	stream_blocks(yreader, xreader, first, n, [&](size_t start, const double *x, const double *y, size_t count) {
+		size_t i = 0;
+		while (i < count) {
+			while (start + i >= bucket_start(b+1, nbuckets, first, n)) b++;
+			size_t bend = min(count, bucket_start(b+1, nbuckets, first, n) - start);
+			if (start + i == bucket_start(b, nbuckets, first, n)) bxfirst[b] = x[i];
+			kernel_minmax(y+i, bend-i, bmin[b], bmax[b]);
+			bxlast[b] = x[bend-1];
+			i = bend;
+		}
+	});
+
+	SWList xlist, minlist, maxlist;
+	for (size_t b = 0; b < nbuckets; b++) {
+		xlist.push_back((bxfirst[b] + bxlast[b]) / 2);
+		// buckets with only NaN values
+		minlist.push_back(bmin[b] == inf ? nan : bmin[b]);
+		maxlist.push_back(bmax[b] == -inf ? nan : bmax[b]);
+	}
 
-    int32 start = 0;
+	SWDict result;
+	result.insert("x", xlist);
+	result.insert("min", minlist);
+	result.insert("max", maxlist);
+	return result;
+}
 
-    switch (data_type) {
-        case DFNT_FLOAT64: {
-			if (nelements == 0) {
-				return SWList();
+static SWDict decimate_lttb(column_reader& yreader, column_reader* xreader, size_t nbuckets, size_t first, size_t n) {
+	// Largest-Triangle-Three-Buckets. The first and last point are kept, 
+	// the others are divided into nbuckets-2 buckets. The first pass computes the
+	// bucket averages, the second one selects the point from each bucket
+	// which forms the largest triangle with the previous selected point
+	// and the average of the next bucket
+	if (nbuckets < 3) STHROW("LTTB needs at least 3 buckets, got "<<nbuckets);
+	
+	SWList xlist, ylist;
+	if (nbuckets >= n) {
+		// nothing to decimate
+		stream_blocks(yreader, xreader, first, n, [&](size_t, const double *x, const double *y, size_t count) {
+			for (size_t i = 0; i < count; i++) {
+				xlist.push_back(x[i]);
+				ylist.push_back(y[i]);
 			}
+		});
+		SWDict result;
+		result.insert("x", xlist);
+		result.insert("y", ylist);
+		return result;
+	}
 
-			vector<double> buf(nelements);
-            if (SDreaddata(sds_id, &start, NULL, dimsizes, &(buf[0])) == FAIL) {
-                STHROW("Error reading 64 bit float values from data set "<<index);
-            }
+	size_t ninner = nbuckets - 2;
+	size_t innerfirst = first + 1;
+	size_t innern = n - 2;
 
-			return SWList(buf);
+	vector<double> xsum(ninner, 0.0), ysum(ninner, 0.0);
+	vector<size_t> xcount(ninner, 0), ycount(ninner, 0);
+	double firstx = 0, firsty = 0, lastx = 0, lasty = 0;
+	
+	size_t b = 0;
+	stream_blocks(yreader, xreader, first, n, [&](size_t start, const double *x, const double *y, size_t count) {
+		size_t i = 0;
+		if (start == first) {
+			firstx = x[0]; firsty = y[0];
+			i = 1;
+		}
+		if (start + count == first + n) {
+			lastx = x[count-1]; lasty = y[count-1];
+			count--;
+		}
+		while (i < count) {
+			while (start + i >= bucket_start(b+1, ninner, innerfirst, innern)) b++;
+			size_t bend = min(count, bucket_start(b+1, ninner, innerfirst, innern) - start);
+			kernel_sum(x+i, bend-i, xsum[b], xcount[b]);
+			kernel_sum(y+i, bend-i, ysum[b], ycount[b]);
+			i = bend;
+		}
+	});
 
-            break;
-        }
-		
-		case DFNT_FLOAT32: {
-			if (nelements == 0) {
-				return SWList();
+	xlist.push_back(firstx);
+	ylist.push_back(firsty);
+	
+	double ax = firstx, ay = firsty;
+	double bestarea = -1, bestx = 0, besty = 0;
+	b = 0;
+	// average of the bucket following b
+	auto nextavg = [&](size_t b, double& cx, double& cy) {
+		if (b+1 >= ninner) {
+			cx = lastx; cy = lasty;
+		} else {
+			cx = xsum[b+1] / xcount[b+1];
+			cy = ysum[b+1] / ycount[b+1];
+		}
+	};
+	double cx, cy;
+	nextavg(b, cx, cy);
+
+	stream_blocks(yreader, xreader, innerfirst, innern, [&](size_t start, const double *x, const double *y, size_t count) {
+		for (size_t i = 0; i < count; i++) {
+			if (start + i >= bucket_start(b+1, ninner, innerfirst, innern)) {
+				// bucket complete
+				xlist.push_back(bestx);
+				ylist.push_back(besty);
+				ax = bestx; ay = besty;
+				bestarea = -1;
+				b++;
+				nextavg(b, cx, cy);
 			}
-
-			vector<float> buf(nelements);
-            if (SDreaddata(sds_id, &start, NULL, dimsizes, &(buf[0])) == FAIL) {
-                STHROW("Error reading 32 bit float values from data set "<<index);
-            }
-
-			return SWList(buf);
-
-            break;
-        }
-
-        case DFNT_INT32: {
-			if (nelements == 0) {
-				return SWList();
+			double area = fabs((ax - cx)*(y[i] - ay) - (ax - x[i])*(cy - ay));
+			// the first point is taken, if all areas are NaN
+			if (area > bestarea || bestarea < 0) {
+				bestarea = (area == area) ? area : 0;
+				bestx = x[i]; besty = y[i];
 			}
+		}
+	});
+	xlist.push_back(bestx);
+	ylist.push_back(besty);
 
-            vector<int32> buf(nelements);
-            if (SDreaddata(sds_id, &start, NULL, dimsizes, &(buf[0])) == FAIL) {
-                STHROW("Error reading 32 bit int values from data set "<<index);
-            }
-            
-            return SWList(buf);
+	xlist.push_back(lastx);
+	ylist.push_back(lasty);
+	
+	SWDict result;
+	result.insert("x", xlist);
+	result.insert("y", ylist);
+	return result;
+}
 
-            break;
-        }
+static SWDict decimate_internal(column_reader& yreader, column_reader* xreader, size_t nbuckets, const string& mode, long first, long last) {
+	if (nbuckets == 0) STHROW("Number of buckets must be positive");
+	size_t start, n;
+	eval_index_range(yreader.size(), first, last, start, n);
 
-        default: {
-            STHROW("Data set "<<index<<" has data type "<<data_type<<" can only read 64bit float, 32bit float  and 32bit int");
-        }
-    }
+	if (mode == "minmax") return decimate_minmax(yreader, xreader, nbuckets, start, n);
+	if (mode == "lttb") return decimate_lttb(yreader, xreader, nbuckets, start, n);
+	STHROW("Unknown decimation mode "<<mode<<", must be minmax or lttb");
 }
 
-SWList HDFpp::readdata(size_t index) { 
-    if (index>=ndatasets) STHROW("Only "<<ndatasets<<" data sets available, requested nr "<<index);
-    int32 sds_id;
-    
-    if ((sds_id=SDselect(hdf_id, index))==FAIL) {
-        STHROW("Can't select data set nr. "<<index);
-    }
-    
-    sds_release srelease(sds_id);
+// rough memory use of the interpreter objects, for the size estimates:
+// per group, data set or attribute, and per element of a list
+static const size_t object_overhead = 256;
+static const size_t element_overhead = 56;
+
+// memory budget of a dump. Data sets which would exceed it are not read
+struct read_budget {
+	size_t limit;
+	size_t used;
+	read_budget(size_t limit) : limit(limit), used(0) { }
+	// reserve the memory for one data set, false if it does not fit
+	bool take(size_t bytes) {
+		if (used + bytes > limit) return false;
+		used += bytes;
+		return true;
+	}
+};
 
-    int32 rank; int32 dimsizes[MAX_VAR_DIMS]; int32 data_type; int32 num_attrs;
+// budget of the running dump, NULL if unlimited
+static thread_local read_budget *budget_active = NULL;
 
-    if (SDgetinfo(sds_id, NULL, &rank, dimsizes, &data_type, &num_attrs)==FAIL) {
-        STHROW("Error getting information for data set "<<index);
-    }
-	
-	return readdata4_internal(sds_id, rank, dimsizes, data_type, index);
-}
+class budget_scope {
+	read_budget budget;
+	read_budget *saved;
+public:
+	budget_scope(size_t limit) : budget(limit), saved(budget_active) {
+		budget_active = (limit > 0) ? &budget : NULL;
+	}
+	~budget_scope() { budget_active = saved; }
+};
 
+// stands in for the data of a data set over the budget: the estimated size
+// and, if a reader is given, a min/max preview
+static const size_t preview_buckets = 1000;
 
-static SWDict readattr4_internal(int32 sds_id, int32 num_attrs, int32 dset_index) {
+static SWDict skipped_data(size_t bytes, column_reader *reader) {
 	SWDict result;
-
-    for (int i=0; i<num_attrs; i++) {
-	
-		char attr_name[64]; int32 data_type; int32 count;
-		if (SDattrinfo(sds_id, i, attr_name, &data_type, &count)==FAIL) {
-			STHROW("Error getting information on attribute "<<i<<", dataset "<<dset_index);
+	result.insert("bytes", bytes);
+	if (reader) {
+		try {
+			result.insert("preview", decimate_internal(*reader, NULL, preview_buckets, "minmax", 0, -1));
+		} catch (const runtime_error&) {
+			// not numeric, no preview
 		}
+	}
+	return result;
+}
 
-		switch (data_type) {
-			case DFNT_FLOAT32: {
-				vector<float> buf(count);
-				if (SDreadattr(sds_id, i, &(buf[0])) == FAIL) {
-					STHROW("Error reading 32 bit float values from attribute "<<i<<", dataset "<<dset_index);
-				}
+static SWDict stats_internal(column_reader& reader) {
+	// count, min, max, sum, mean and sample variance of the non-NaN values.
+	// Each block contributes its count, mean and squared deviations,
+	// which are merged by the pairwise update of Chan et al.
+	const double inf = numeric_limits<double>::infinity();
+	const double nan = numeric_limits<double>::quiet_NaN();
+	size_t count = 0;
+	double mn = inf, mx = -inf, sum = 0.0, mean = 0.0, m2 = 0.0;
+
+	size_t n = reader.size();
+	stream_blocks(reader, NULL, 0, n, [&](size_t, const double *, const double *y, size_t blen) {
+		double bsum = 0.0;
+		size_t bcount = 0;
+		kernel_sum(y, blen, bsum, bcount);
+		if (bcount == 0) return;
+		kernel_minmax(y, blen, mn, mx);
+		
+		double bmean = bsum / bcount;
+		double bm2 = kernel_sqdev(y, blen, bmean);
+		double delta = bmean - mean;
+		size_t total = count + bcount;
+		mean += delta * bcount / total;
+		m2 += bm2 + delta * delta * (double(count) * bcount / total);
+		count = total;
+		sum += bsum;
+	});
 
-				if (count == 1) {
-					result.insert(attr_name, buf[0]);
-				} else {
-					result.insert(attr_name, SWList(buf));
-				}
-				break;
-			}
+	SWDict result;
+	result.insert("count", count);
+	result.insert("nans", n - count);
+	result.insert("min", count ? mn : nan);
+	result.insert("max", count ? mx : nan);
+	result.insert("sum", sum);
+	result.insert("mean", count ? mean : nan);
+	result.insert("variance", count > 1 ? m2 / (count - 1) : nan);
+	return result;
+}
 
+// column held in memory, e.g. the result of a join
+class memory_column_reader : public column_reader {
+	vector<double> data;
+public:
+	memory_column_reader(vector<double>& values) {
+		data.swap(values);
+	}
 
-			case DFNT_FLOAT64: {
-				vector<double> buf(count);
-				if (SDreadattr(sds_id, i, &(buf[0])) == FAIL) {
-					STHROW("Error reading 64 bit float values from attribute "<<i<<", dataset "<<dset_index);
-				}
+	size_t size() const {
+		return data.size();
+	}
 
-				if (count == 1) {
-					result.insert(attr_name, buf[0]);
-				} else {
-					result.insert(attr_name, SWList(buf));
-				}
+	void read(size_t start, size_t count, double *out) {
+		copy(data.begin() + start, data.begin() + start + count, out);
+	}
+};
 
-				break;
-			}
+// Expressions over columns, evaluated block by block. 
+// Constants have no length and fit to any column
+static const size_t expr_unbounded = numeric_limits<size_t>::max();
 
-			case DFNT_INT32: {
-				vector<int32> buf(count);
-				if (SDreadattr(sds_id, i, &(buf[0])) == FAIL) {
-					STHROW("Error reading 32 bit int values from attribute "<<i<<", dataset "<<dset_index);
-				}
-				
-				if (count == 1) {
-					result.insert(attr_name, buf[0]);
-				} else {
-					result.insert(attr_name, SWList(buf));
-				}
-				
-				break;
-			}
+class expr_node {
+public:
+	virtual ~expr_node() { }
+	virtual size_t size() const = 0;
+	virtual void eval(size_t start, size_t count, double *out) = 0;
+};
 
-			case DFNT_CHAR8: {
-				vector<char> buf(count);
-				if (SDreadattr(sds_id, i, &(buf[0])) == FAIL) {
-					STHROW("Error reading char values (string) from attribute "<<i<<", dataset "<<dset_index);
-				}
-				
-				result.insert(attr_name, string(&(buf[0]), count));
-				
-				break;
+typedef unique_ptr<expr_node> expr_ptr;
 
+class expr_const : public expr_node {
+	double value;
+public:
+	expr_const(double value) : value(value) { }
+	size_t size() const { return expr_unbounded; }
+	void eval(size_t, size_t count, double *out) {
+		fill(out, out + count, value);
+	}
+};
 
-			}
+class expr_column : public expr_node {
+	column_reader &reader;
+public:
+	expr_column(column_reader &reader) : reader(reader) { }
+	size_t size() const { return reader.size(); }
+	void eval(size_t start, size_t count, double *out) {
+		reader.read(start, count, out);
+	}
+};
 
-			default: {
-				STHROW("Attribute "<<i<<" of data set "<<dset_index<<" has data type "<<data_type<<" can only read 64bit float, 32bit int and string (char8)");
-			}
+class expr_binop : public expr_node {
+	kernel_op op;
+	expr_ptr a, b;
+	vector<double> bbuf;
+public:
+	expr_binop(kernel_op op, expr_ptr& left, expr_ptr& right) : op(op), a(move(left)), b(move(right)) {
+		if (a->size() != expr_unbounded && b->size() != expr_unbounded && a->size() != b->size()) {
+			STHROW("Operands have different lengths "<<a->size()<<" and "<<b->size());
 		}
 	}
+	size_t size() const { return min(a->size(), b->size()); }
+	void eval(size_t start, size_t count, double *out) {
+		if (bbuf.size() < count) bbuf.resize(count);
+		a->eval(start, count, out);
+		b->eval(start, count, &bbuf[0]);
+		kernel_binop(op, out, &bbuf[0], out, count);
+	}
+};
 
-	return result;
-}
-
+class expr_func : public expr_node {
+	double (*func)(double);
+	expr_ptr a;
+public:
+	expr_func(double (*func)(double), expr_ptr& arg) : func(func), a(move(arg)) { }
+	size_t size() const { return a->size(); }
+	void eval(size_t start, size_t count, double *out) {
+		a->eval(start, count, out);
+		for (size_t i = 0; i < count; i++) out[i] = func(out[i]);
+	}
+};
 
-SWDict HDFpp::readattrs(size_t index) { 
-    if (index>=ndatasets) STHROW("Only "<<ndatasets<<" data sets available, requested nr "<<index);
-    int32 sds_id;
-    
-    if ((sds_id=SDselect(hdf_id, index))==FAIL) {
-        STHROW("Can't select data set nr. "<<index);
-    }
-    
-    sds_release srelease(sds_id);
+// diff(a)[i] = a[i+1] - a[i], one element shorter than a
+class expr_diff : public expr_node {
+	expr_ptr a;
+	vector<double> abuf;
+public:
+	expr_diff(expr_ptr& arg) : a(move(arg)) {
+		if (a->size() == expr_unbounded) STHROW("diff needs a data set as argument");
+	}
+	size_t size() const { return a->size() > 0 ? a->size() - 1 : 0; }
+	void eval(size_t start, size_t count, double *out) {
+		if (abuf.size() < count + 1) abuf.resize(count + 1);
+		a->eval(start, count + 1, &abuf[0]);
+		kernel_binop(kernel_sub, &abuf[1], &abuf[0], out, count);
+	}
+};
 
-    int32 rank; int32 dimsizes[MAX_VAR_DIMS]; int32 data_type; int32 num_attrs;
+static double expr_neg(double x) { return -x; }
+static double expr_log(double x) { return log(x); }
+static double expr_log10(double x) { return log10(x); }
+static double expr_exp(double x) { return exp(x); }
+static double expr_sqrt(double x) { return sqrt(x); }
+static double expr_abs(double x) { return fabs(x); }
+
+// recursive descent parser for expressions like "log(a/b)*2+c"
+class expr_parser {
+	const string &text;
+	size_t pos;
+	const unordered_map<string, column_reader*> &vars;
+
+	void skipspace() {
+		while (pos < text.size() && isspace((unsigned char)text[pos])) pos++;
+	}
 
-    if (SDgetinfo(sds_id, NULL, &rank, dimsizes, &data_type, &num_attrs)==FAIL) {
-        STHROW("Error getting information for data set "<<index);
-    }
+	bool accept(char c) {
+		skipspace();
+		if (pos < text.size() && text[pos] == c) {
+			pos++;
+			return true;
+		}
+		return false;
+	}
 
-    return readattr4_internal(sds_id, num_attrs, index);
-}
+	void expect(char c) {
+		if (!accept(c)) STHROW("Expected '"<<c<<"' at position "<<pos<<" in expression "<<text);
+	}
 
-SWDict HDFpp::readglobalattrs() {
-	// reading global attributes is implemented
-	// by reading the attributes from the hdf_id
-	return readattr4_internal(hdf_id, nglobal_attrs, -1);
-	// -1 is just a fudge value, only for the error messages
-}
+	expr_ptr sum() {
+		expr_ptr left = product();
+		while (true) {
+			kernel_op op;
+			if (accept('+')) op = kernel_add;
+			else if (accept('-')) op = kernel_sub;
+			else return left;
+			expr_ptr right = product();
+			left = expr_ptr(new expr_binop(op, left, right));
+		}
+	}
 
+	expr_ptr product() {
+		expr_ptr left = unary();
+		while (true) {
+			kernel_op op;
+			if (accept('*')) op = kernel_mul;
+			else if (accept('/')) op = kernel_div;
+			else return left;
+			expr_ptr right = unary();
+			left = expr_ptr(new expr_binop(op, left, right));
+		}
+	}
 
-SWObject HDFpp::dump() {
-	// dump the data sets as one big dictionary
-	SWList result;
-	if (nglobal_attrs != 0) {
-		// if we have global attributes, insert them as a first dataset
-		// with an empty name
-		SWDict entry;
-		SWDict attrs = readglobalattrs();
-		SWList data; // empty list
-		entry.insert("name", string());
-		entry.insert("attrs", attrs);
-		entry.insert("data", data);
-		result.push_back(entry);
+	expr_ptr unary() {
+		if (accept('-')) {
+			expr_ptr arg = unary();
+			return expr_ptr(new expr_func(expr_neg, arg));
+		}
+		return primary();
 	}
-	for (size_t index = 0; index < get_num_datasets(); index++) {
+
+	expr_ptr primary() {
+		skipspace();
+		if (accept('(')) {
+			expr_ptr result = sum();
+			expect(')');
+			return result;
+		}
 		
-		int32 sds_id;
-		if ((sds_id=SDselect(hdf_id, index))==FAIL) {
-			STHROW("Can't select data set nr. "<<index);
+		if (pos < text.size() && (isdigit((unsigned char)text[pos]) || text[pos] == '.')) {
+			const char *begin = text.c_str() + pos;
+			char *end;
+			double value = strtod(begin, &end);
+			pos += end - begin;
+			return expr_ptr(new expr_const(value));
 		}
-    
-		sds_release srelease(sds_id);
+
+		size_t begin = pos;
+		while (pos < text.size() && (isalnum((unsigned char)text[pos]) || text[pos] == '_')) pos++;
+		if (begin == pos) STHROW("Syntax error at position "<<pos<<" in expression "<<text);
+		string name = text.substr(begin, pos - begin);
 		
-		uint16 nlen;
-		if (SDgetnamelen(sds_id, &nlen)==FAIL) {
-			STHROW("Error getting name length for data set "<<index);
+		if (accept('(')) {
+			expr_ptr arg = sum();
+			expect(')');
+			if (name == "diff") return expr_ptr(new expr_diff(arg));
+			double (*func)(double) = NULL;
+			if (name == "log") func = expr_log;
+			else if (name == "log10") func = expr_log10;
+			else if (name == "exp") func = expr_exp;
+			else if (name == "sqrt") func = expr_sqrt;
+			else if (name == "abs") func = expr_abs;
+			else STHROW("Unknown function "<<name<<", must be log, log10, exp, sqrt, abs or diff");
+			return expr_ptr(new expr_func(func, arg));
 		}
 
-		vector <char> sds_name(nlen+1);
-		int32 rank; int32 dimsizes[MAX_VAR_DIMS]; int32 data_type; int32 num_attrs;
+		auto it = vars.find(name);
+		if (it == vars.end()) STHROW("Unknown operand "<<name<<" in expression "<<text);
+		return expr_ptr(new expr_column(*it->second));
+	}
 
-		if (SDgetinfo(sds_id, &(sds_name[0]), &rank, dimsizes, &data_type, &num_attrs)==FAIL) {
-			STHROW("Error getting information for data set "<<index);
-		}
-		
-		SWDict entry; 
-		SWDict attrs = readattr4_internal(sds_id, num_attrs, index);
-		SWList data = readdata4_internal(sds_id, rank, dimsizes, data_type, index);
-		entry.insert("name", string(&(sds_name[0]), nlen));
-		entry.insert("attrs", attrs);
-		entry.insert("data", data);
-		result.push_back(entry);
+public:
+	expr_parser(const string &text, const unordered_map<string, column_reader*> &vars) : text(text), pos(0), vars(vars) { }
+
+	expr_ptr parse() {
+		expr_ptr result = sum();
+		skipspace();
+		if (pos != text.size()) STHROW("Syntax error at position "<<pos<<" in expression "<<text);
+		return result;
 	}
-	return result;
-}
+};
 
-#ifdef HAVE_HDF5
-H5pp::H5pp(const char *fname) : file(-1) {
-	// 1. Create a File Access Property List (FAPL)
-	hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
-	if (fapl >= 0) {
-		// 2. Disable file locking (use_file_locking = false, ignore_disabled_locks = true)
-		H5Pset_file_locking(fapl, false, true);
+static SWDict compute_internal(const string& expression, const unordered_map<string, column_reader*>& vars, size_t& n) {
+	expr_ptr root = expr_parser(expression, vars).parse();
+	if (root->size() == expr_unbounded) STHROW("Expression "<<expression<<" does not refer to any data set");
+	
+	n = root->size();
+	vector<double> result(n);
+	for (size_t start = 0; start < n; start += streamblock) {
+		size_t count = min(streamblock, n - start);
+		root->eval(start, count, &result[start]);
 	}
 
-	// 3. Open the file passing our custom property list instead of H5P_DEFAULT
-	file = H5Fopen(fname, H5F_ACC_RDONLY, fapl);
+	return make_packed("float64", vector<long>(1, n), result);
+}
 
-	// 4. Close the property list handle to prevent resource leaks
-	if (fapl >= 0) {
-		H5Pclose(fapl);
+// a numeric data set, or the numeric members of a compound data set, read in
+// blocks of rows (along the first dimension) as records of native values
+class export_source {
+public:
+	struct column {
+		string name;
+		string dtype;
+		size_t offset; // in the record
+	};
+	string path;
+	vector<unsigned long long> shape;
+	vector<column> columns;
+	size_t recsize;
+
+	virtual ~export_source() { }
+	// a scalar is a single row
+	size_t rows() const {
+		return shape.empty() ? 1 : shape[0];
 	}
-
-	if (file < 0) {
-		// can't read the file
-		STHROW("Can't open " << fname);
+	// records per row
+	size_t rowsize() const {
+		size_t n = 1;
+		for (size_t d = 1; d < shape.size(); d++) n *= shape[d];
+		return n;
 	}
+	virtual void read(size_t row, size_t nrows, char *out) = 0;
+};
+
+// the values of one column, or the records themselves if there is only one
+static const char *export_column(const export_source& src, size_t c, const vector<char>& records, size_t nrec, vector<char>& buf) {
+	if (src.columns.size() == 1) return records.data();
+	size_t elsize = column_elsize(src.columns[c].dtype);
+	buf.resize(nrec*elsize);
+	const char *rec = records.data() + src.columns[c].offset;
+	for (size_t i = 0; i < nrec; i++) memcpy(&buf[i*elsize], rec + i*src.recsize, elsize);
+	return buf.data();
 }
 
-H5pp::~H5pp () { close(); }
+// one .npy file per column in the directory dir, named after the
+// column with characters other than letters, digits, - and . replaced by _
+static SWList export_npy(vector< unique_ptr<export_source> >& sources, const string& dir) {
+	SWList files;
+	vector<char> records, buf;
+	for (size_t s = 0; s < sources.size(); s++) {
+		export_source& src = *sources[s];
+		vector< unique_ptr<npy_writer> > writers;
+		for (size_t c = 0; c < src.columns.size(); c++) {
+			string name = src.columns[c].name;
+			for (size_t i = 0; i < name.size(); i++) {
+				if (!isalnum(static_cast<unsigned char>(name[i])) && name[i] != '-' && name[i] != '.') name[i] = '_';
+			}
+			size_t first = name.find_first_not_of('_');
+			string fname = dir + "/" + (first == string::npos ? name : name.substr(first)) + ".npy";
+			writers.push_back(unique_ptr<npy_writer>(new npy_writer(fname, src.columns[c].dtype, src.shape)));
+			files.push_back(fname);
+		}
+		// blocks of about 1 MiB, but at least one row
+		size_t rowbytes = src.rowsize() * src.recsize;
+		size_t block = max<size_t>(1, (1 << 20) / max<size_t>(rowbytes, 1));
+		for (size_t row = 0; row < src.rows() && rowbytes > 0; row += block) {
+			size_t n = min(block, src.rows() - row);
+			records.resize(n*rowbytes);
+			src.read(row, n, &records[0]);
+			size_t nrec = n*src.rowsize();
+			for (size_t c = 0; c < src.columns.size(); c++) {
+				writers[c]->write(export_column(src, c, records, nrec, buf), nrec*column_elsize(src.columns[c].dtype));
+			}
+		}
+		for (size_t c = 0; c < writers.size(); c++) writers[c]->close();
+	}
+	return files;
+}
 
+// a single Arrow IPC stream with all columns, one record batch per block of rows
+static SWList export_arrow(vector< unique_ptr<export_source> >& sources, const string& fname) {
+	vector<string> names, dtypes;
+	size_t nrows = 0;
+	for (size_t s = 0; s < sources.size(); s++) {
+		export_source& src = *sources[s];
+		if (src.shape.size() > 1) STHROW("Data set "<<src.path<<" has rank "<<src.shape.size()<<", Arrow export needs 1D data sets");
+		if (s == 0) nrows = src.rows();
+		if (src.rows() != nrows) {
+			STHROW("Data sets have different lengths, "<<sources[0]->path<<" has "<<nrows<<" rows, "<<src.path<<" has "<<src.rows());
+		}
+		for (size_t c = 0; c < src.columns.size(); c++) {
+			names.push_back(src.columns[c].name);
+			dtypes.push_back(src.columns[c].dtype);
+		}
+	}
 
-void H5pp::close() {
-	if (file >= 0) {
-		H5Fclose(file);
-		file = -1; // Reset to avoid dangling descriptor states
+	arrow_writer w(fname, names, dtypes);
+	vector< vector<char> > records(sources.size()), bufs(names.size());
+	vector<const void*> columns(names.size());
+	for (size_t row = 0; row < nrows; row += streamblock) {
+		size_t n = min(streamblock, nrows - row);
+		size_t col = 0;
+		for (size_t s = 0; s < sources.size(); s++) {
+			export_source& src = *sources[s];
+			records[s].resize(n*src.recsize);
+			src.read(row, n, &records[s][0]);
+			for (size_t c = 0; c < src.columns.size(); c++, col++) {
+				columns[col] = export_column(src, c, records[s], n, bufs[col]);
+			}
+		}
+		w.batch(n, columns);
 	}
+	w.close();
+	return SWList(names);
 }
 
-void readlink5_internal(hid_t loc_id, const char *name, const H5L_info_t* info, SWDict& linkdata);
-void readattr5_internal(hid_t loc_id, SWDict& attrs);
-void readdataset5_internal(hid_t loc_id, const char *name, SWDict& datasetdata);
-void readdatatype5_internal(hid_t loc_id, const char *name, SWDict& datatypedata);
+static SWList export_columns(vector< unique_ptr<export_source> >& sources, const char *fname, const string& format) {
+	if (format == "arrow") return export_arrow(sources, fname);
+	return export_npy(sources, fname);
+}
 
-void readgroup5_recursive(hid_t loc_id, const char *name, SWDict& groupdump, int maxlevel);
+static void export_check_format(const string& format) {
+	if (format != "arrow" && format != "npy") STHROW("Unknown format "<<format<<", must be arrow or npy");
+}
 
-SWObject H5pp::dump(int maxlevel, const char* root) {
-	SWDict result;
-	// read root group of HDF5
-	readgroup5_recursive(file, root, result, maxlevel);
-	return result;
+HDFpp::HDFpp(const char *fname) : hdf_id(0), budget(0) {
+    hdf_id = SDstart(fname, DFACC_READ);
+    if (hdf_id==FAIL) STHROW("Can't open "<<fname);
+    int32 num_datasets; int32 num_global_attrs;
+    
+    if (SDfileinfo(hdf_id, &num_datasets, &num_global_attrs) == FAIL) {
+        STHROW("Error reading file information for "<<fname);
+    }
+
+    ndatasets = num_datasets;
+    nglobal_attrs = num_global_attrs;
 }
 
-extern "C" herr_t dumpgroup_callback (hid_t loc_id, const char *name, const H5L_info_t *info, void *operator_data);
+HDFpp::~HDFpp() {
+    close();
+}
 
-struct recursedata {
-	SWDict* groupdata;
-	int level;
-};
+void HDFpp::close() {
+    SDend(hdf_id);
+}
 
-void readgroup5_recursive(hid_t loc_id, const char *name, SWDict& groupdump, int maxlevel) {
-	groupdump.insert("type", "GROUP");
-	groupdump.insert("name", name);
-	
-	// open the group
-	hid_t group_id=H5Gopen(loc_id, name, H5P_DEFAULT);
+// ensure that SDendaccess is called for every possible exit - grrr
+class sds_release {
+	int32 id;
+public:
+	sds_release(int32 id) : id(id) { }
+	~sds_release() {
+		SDendaccess(id);
+	}
+};
 
-	SWDict attrs;
-	readattr5_internal(group_id, attrs);
-	groupdump.insert("attrs", attrs);
 
-	SWDict data;
-	int level = maxlevel - 1;
 
-	if (level != 0) {
-	
-		recursedata rdata { &data, level };
-		H5Literate (group_id, H5_INDEX_NAME, 
-			H5_ITER_NATIVE, NULL, dumpgroup_callback, (void *) &rdata);
+// keeps the data sets selected during a batch read open until the batch is done
+class sds_batch {
+	int32 hdf_id;
+	unordered_map<size_t, int32> ids;
+public:
+	sds_batch(int32 hdf_id) : hdf_id(hdf_id) { }
+	~sds_batch() {
+		for (auto &id : ids) SDendaccess(id.second);
 	}
-	
-	// close it
-	H5Gclose(group_id);
-	groupdump.insert("data", data);
 
-}
+	int32 select(size_t index) {
+		auto it = ids.find(index);
+		if (it != ids.end()) return it->second;
 
-herr_t dumpgroup_callback (hid_t loc_id, const char *name, const H5L_info_t *info, void *operator_data) {
-	recursedata rdata = *((recursedata *) operator_data);
+		int32 sds_id = SDselect(hdf_id, index);
+		if (sds_id == FAIL) {
+			STHROW("Can't select data set nr. "<<index);
+		}
+		ids[index] = sds_id;
+		return sds_id;
+	}
+};
 
-	if (info->type == H5L_TYPE_SOFT) {
-		// soft link. 
-		SWDict sldata;
-		readlink5_internal(loc_id, name, info, sldata);
-		// Insert soft link data into list
-		rdata.groupdata -> insert(name, sldata);
-		return 0; // Success
+static const char * h4_typename(int32 data_type) {
+	switch (data_type) {
+		case DFNT_CHAR8: return "char8";
+		case DFNT_UCHAR8: return "uchar8";
+		case DFNT_INT8: return "int8";
+		case DFNT_UINT8: return "uint8";
+		case DFNT_INT16: return "int16";
+		case DFNT_UINT16: return "uint16";
+		case DFNT_INT32: return "int32";
+		case DFNT_UINT32: return "uint32";
+		case DFNT_FLOAT32: return "float32";
+		case DFNT_FLOAT64: return "float64";
+		default: return "unknown";
 	}
+}
 
-	// other types: get object info
-	H5O_info_t      infobuf;
-	herr_t status = H5Oget_info_by_name (loc_id, name, &infobuf, H5O_INFO_ALL, H5P_DEFAULT);
-    
-	if (status<0) {
-		// pass error on
-		return status;
+static const char * h4_compname(int comp_type) {
+	switch (comp_type) {
+		case COMP_CODE_NONE: return "none";
+		case COMP_CODE_RLE: return "rle";
+		case COMP_CODE_NBIT: return "nbit";
+		case COMP_CODE_SKPHUFF: return "skphuff";
+		case COMP_CODE_DEFLATE: return "deflate";
+		case COMP_CODE_SZIP: return "szip";
+		case COMP_CODE_JPEG: return "jpeg";
+		default: return "unknown";
 	}
+}
 
-    switch (infobuf.type) {
-        case H5O_TYPE_GROUP: {
-			/* Loop detector - disabled for now ***
-            if ( group_check (od, infobuf.addr) ) {
-                printf ("%*s  Warning: Loop detected!\n", spaces, "");
-            } **/
+void HDFpp::ensure_sdstable() {
+	// read the information for all data sets once, 
+	// getname, readdata etc. then only need the table
+	if (!sdstable.empty() || ndatasets == 0) return;
 
-			SWDict subgroupdata;
-			readgroup5_recursive(loc_id, name, subgroupdata, rdata.level);
-			rdata.groupdata -> insert(name, subgroupdata);
-            break;
+	vector<sds_meta> table(ndatasets);
+	unordered_map<string, size_t> nameindex;
+	
+	for (size_t index = 0; index < ndatasets; index++) {
+		int32 sds_id;
+		if ((sds_id=SDselect(hdf_id, index))==FAIL) {
+			STHROW("Can't select data set nr. "<<index);
 		}
-        case H5O_TYPE_DATASET: {
-            SWDict datasetdata;
-			readdataset5_internal(loc_id, name, datasetdata);
-			rdata.groupdata -> insert(name, datasetdata);
-            break;
+    
+		sds_release srelease(sds_id);
+		
+		uint16 nlen;
+		if (SDgetnamelen(sds_id, &nlen)==FAIL) {
+			STHROW("Error getting name length for data set "<<index);
 		}
-        case H5O_TYPE_NAMED_DATATYPE: {
-            SWDict datatypedata;
-			readdatatype5_internal(loc_id, name, datatypedata);
-			rdata.groupdata -> insert(name, datatypedata);
-            break;
+
+		vector <char> sds_name(nlen+1);
+		int32 rank; int32 dimsizes[MAX_VAR_DIMS]; int32 data_type; int32 num_attrs;
+
+		if (SDgetinfo(sds_id, &(sds_name[0]), &rank, dimsizes, &data_type, &num_attrs)==FAIL) {
+			STHROW("Error getting information for data set "<<index);
 		}
-        default: {
-            // Unknown. Append mock object
-			SWDict unknown;
-			unknown.insert("type", "UNKNOWN");
-			unknown.insert("name", name);
-			rdata.groupdata -> insert(name, unknown);
+
+		comp_coder_t comp_type;
+		if (SDgetcomptype(sds_id, &comp_type)==FAIL) {
+			// e.g. empty data sets have no compression information
+			comp_type = COMP_CODE_NONE;
 		}
-    }
 
-    return 0; //Success
-}
+		sds_meta &meta = table[index];
+		meta.name = string(&(sds_name[0]), nlen);
+		meta.rank = rank;
+		meta.dims.assign(dimsizes, dimsizes+rank);
+		meta.data_type = data_type;
+		meta.num_attrs = num_attrs;
+		meta.comp_type = comp_type;
 
-void readlink5_internal(hid_t loc_id, const char *name, const H5L_info_t* info, SWDict& linkdata) { 
-	vector<char> targbuf(info->u.val_size+1);
+		// names are not unique, the first one wins as in SDnametoindex
+		nameindex.insert(make_pair(meta.name, index));
+	}
 
-	if (H5Lget_val(loc_id, name, &targbuf[0], info->u.val_size, H5P_DEFAULT)<0) {
-		return; //Error
+	sdstable.swap(table);
+	sdsindex.swap(nameindex);
+}
+
+size_t HDFpp::resolve(const SWList& items, size_t i) {
+	// list items can be data set names or indices
+	ensure_sdstable();
+	string item = items.getString(i);
+	auto it = sdsindex.find(item);
+	if (it != sdsindex.end()) return it->second;
+
+	long index;
+	if (items.getLong(i, index)) {
+		if (index < 0 || size_t(index) >= ndatasets) {
+			STHROW("Only "<<ndatasets<<" data sets available, requested nr "<<index);
+		}
+		return index;
 	}
 	
-	SWDict attrs;
-	//readattr5_internal(loc_id, attrs);
+	STHROW("No data set named "<<item);
+}
 
-	linkdata.insert("type", "SOFTLINK");
-	linkdata.insert("name", name);
-	linkdata.insert("attrs", attrs);
+string HDFpp::getname(size_t index) {
+	if (index>=ndatasets) STHROW("Only "<<ndatasets<<" data sets available, requested nr "<<index);
+	ensure_sdstable();
+	return sdstable[index].name;
+}
 
-	linkdata.insert("data", &targbuf[0]);
+size_t HDFpp::getindex(const string& name) {
+	ensure_sdstable();
+	auto it = sdsindex.find(name);
+	if (it == sdsindex.end()) STHROW("No data set named "<<name);
+	return it->second;
+}
 
+SWDict HDFpp::getinfo(size_t index) {
+	if (index>=ndatasets) STHROW("Only "<<ndatasets<<" data sets available, requested nr "<<index);
+	ensure_sdstable();
+	const sds_meta &meta = sdstable[index];
+
+	SWDict result;
+	result.insert("name", meta.name);
+	result.insert("rank", meta.rank);
+	result.insert("dims", SWList(meta.dims));
+	result.insert("dtype", h4_typename(meta.data_type));
+	result.insert("nattrs", meta.num_attrs);
+	result.insert("compression", h4_compname(meta.comp_type));
+	return result;
 }
 
-// which interface to use to read the data
-enum h5_api {
-	h5a_api,
-	h5d_api
+
+// selection of a hyperslab in an SDS, as passed to SDreaddata
+struct sds_slab {
+	vector<int32> start;
+	vector<int32> edge;
+	vector<int32> stride;
+	bool unitstride;
+	vector<long> shape;
+	size_t nelements;
 };
 
+static void eval_sds_slab(const sds_meta& meta, const SWList& start, const SWList& edge, const SWList& stride, sds_slab& slab, int32 index) {
+	// empty lists select the full data set
+	size_t rank = meta.rank;
+	if (start.size() != 0 && start.size() != rank) STHROW("Data set "<<index<<" has rank "<<rank<<", got "<<start.size()<<" start values");
+	if (edge.size() != 0 && edge.size() != rank) STHROW("Data set "<<index<<" has rank "<<rank<<", got "<<edge.size()<<" edge values");
+	if (stride.size() != 0 && stride.size() != rank) STHROW("Data set "<<index<<" has rank "<<rank<<", got "<<stride.size()<<" stride values");
+	
+	slab.start.assign(rank, 0);
+	slab.edge.assign(rank, 0);
+	slab.stride.assign(rank, 1);
+	slab.shape.assign(rank, 0);
+	slab.unitstride = true;
+	slab.nelements = (rank > 0)?1:0;
+
+	for (size_t d = 0; d < rank; d++) {
+		long dim = meta.dims[d];
+		long st = 0, ed = -1, str = 1;
+		if (start.size() != 0 && !start.getLong(d, st)) STHROW("Expected integer start value, got "<<start.getString(d));
+		if (edge.size() != 0 && !edge.getLong(d, ed)) STHROW("Expected integer edge value, got "<<edge.getString(d));
+		if (stride.size() != 0 && !stride.getLong(d, str)) STHROW("Expected integer stride value, got "<<stride.getString(d));
+
+		if (str < 1) STHROW("Stride must be positive, got "<<str);
+		if (st < 0 || (st > 0 && st >= dim)) STHROW("Start index "<<st<<" out of range for dimension "<<d<<" of size "<<dim);
+		if (ed < 0) {
+			// take all remaining elements
+			ed = (dim - st + str - 1) / str;
+		} else if (ed > 0 && st + (ed - 1)*str >= dim) {
+			STHROW("Hyperslab exceeds dimension "<<d<<" of size "<<dim);
+		}
 
-// replicate HDF5 native datatypes for 
-// the use in switch statements
-enum my_dtype {
-	MY_UNKNOWN,
-	MY_NATIVE_CHAR,
-	MY_NATIVE_SHORT,
-	MY_NATIVE_INT,
-	MY_NATIVE_LONG,
-	MY_NATIVE_LLONG,
-	MY_NATIVE_UCHAR,
-	MY_NATIVE_USHORT,
-	MY_NATIVE_UINT,
-	MY_NATIVE_ULONG,
-	MY_NATIVE_ULLONG,
-	MY_NATIVE_FLOAT,
-	MY_NATIVE_DOUBLE,
-	MY_NATIVE_LDOUBLE,
-	MY_NATIVE_C_S1
+		slab.start[d] = st;
+		slab.edge[d] = ed;
+		slab.stride[d] = str;
+		slab.shape[d] = ed;
+		if (str != 1) slab.unitstride = false;
+		slab.nelements *= ed;
+	}
+}
+
+template <typename T>
+static void readslab4_typed(int32 sds_id, sds_slab& slab, vector<T>& buf, int32 index) {
+	buf.resize(slab.nelements);
+	if (slab.nelements == 0) return;
+	PERF_COUNT(allocations, 1);
+	PERF_COUNT(bytes, slab.nelements*sizeof(T));
+	perf_timer timer(&perf_counters::t_io);
+
+	// with stride, only the selected points are transferred
+	int32 *stride = slab.unitstride ? NULL : &slab.stride[0];
+	if (SDreaddata(sds_id, &slab.start[0], stride, &slab.edge[0], &buf[0]) == FAIL) {
+		STHROW("Error reading "<<sizeof(T)*8<<" bit values from data set "<<index);
+	}
+}
+
+template <typename T, typename TOUT>
+static SWObject readslab4_convert(int32 sds_id, sds_slab& slab, const sds_meta& meta, bool packed, int32 index) {
+	vector<T> buf;
+	readslab4_typed(sds_id, slab, buf, index);
+	perf_timer timer(&perf_counters::t_marshal);
+	if (packed) {
+		PERF_COUNT(created, 1);
+		return make_packed(h4_typename(meta.data_type), slab.shape, buf);
+	}
+
+	PERF_COUNT(created, buf.size() + 1);
+	SWList result;
+	for (size_t i = 0; i < buf.size(); i++) {
+		result.push_back(static_cast<TOUT>(buf[i]));
+	}
+	return result;
+}
+
+static SWObject readslab4_internal(int32 sds_id, sds_slab& slab, const sds_meta& meta, bool packed, int32 index) {
+	// multidimensional data is returned as a flat list in C order
+	switch (meta.data_type) {
+		case DFNT_FLOAT64: return readslab4_convert<float64, double>(sds_id, slab, meta, packed, index);
+		case DFNT_FLOAT32: return readslab4_convert<float32, float>(sds_id, slab, meta, packed, index);
+		case DFNT_INT8: return readslab4_convert<int8, int>(sds_id, slab, meta, packed, index);
+		case DFNT_UINT8: 
+		case DFNT_UCHAR8: return readslab4_convert<uint8, int>(sds_id, slab, meta, packed, index);
+		case DFNT_INT16: return readslab4_convert<int16, int>(sds_id, slab, meta, packed, index);
+		case DFNT_UINT16: return readslab4_convert<uint16, int>(sds_id, slab, meta, packed, index);
+		case DFNT_INT32: return readslab4_convert<int32, int>(sds_id, slab, meta, packed, index);
+		case DFNT_UINT32: return readslab4_convert<uint32, long long>(sds_id, slab, meta, packed, index);
+		case DFNT_CHAR8: {
+			vector<char8> buf;
+			readslab4_typed(sds_id, slab, buf, index);
+			if (packed) return make_packed(h4_typename(meta.data_type), slab.shape, buf);
+			// text stored as an SDS
+			SWObject result;
+			result.MakeBasic(string(buf.begin(), buf.end()));
+			return result;
+		}
+		default: {
+			STHROW("Data set "<<index<<" has unsupported data type "<<meta.data_type);
+		}
+	}
+}
+
+// streaming access to a 1D SDS
+class h4_column_reader : public column_reader {
+	int32 sds_id;
+	sds_meta meta;
+	int32 index;
+
+	template <typename T>
+	void read_typed(int32 start, int32 count, double *out) {
+		vector<T> buf(count);
+		if (SDreaddata(sds_id, &start, NULL, &count, &buf[0]) == FAIL) {
+			STHROW("Error reading values from data set "<<index);
+		}
+		for (int32 i = 0; i < count; i++) out[i] = buf[i];
+	}
+
+public:
+	h4_column_reader(int32 hdf_id, const sds_meta& meta, int32 index) : meta(meta), index(index) {
+		if (meta.rank != 1) STHROW("Data set "<<index<<" has rank "<<meta.rank<<", expected 1d array.");
+		if ((sds_id=SDselect(hdf_id, index))==FAIL) {
+			STHROW("Can't select data set nr. "<<index);
+		}
+	}
+
+	~h4_column_reader() {
+		SDendaccess(sds_id);
+	}
+
+	size_t size() const {
+		return meta.dims[0];
+	}
+
+	void read(size_t start, size_t count, double *out) {
+		if (count == 0) return;
+		switch (meta.data_type) {
+			case DFNT_FLOAT64: {
+				// no conversion needed
+				int32 st = start, ed = count;
+				if (SDreaddata(sds_id, &st, NULL, &ed, out) == FAIL) {
+					STHROW("Error reading 64 bit float values from data set "<<index);
+				}
+				break;
+			}
+			case DFNT_FLOAT32: read_typed<float32>(start, count, out); break;
+			case DFNT_INT8: read_typed<int8>(start, count, out); break;
+			case DFNT_UINT8:
+			case DFNT_UCHAR8: read_typed<uint8>(start, count, out); break;
+			case DFNT_INT16: read_typed<int16>(start, count, out); break;
+			case DFNT_UINT16: read_typed<uint16>(start, count, out); break;
+			case DFNT_INT32: read_typed<int32>(start, count, out); break;
+			case DFNT_UINT32: read_typed<uint32>(start, count, out); break;
+			default: {
+				STHROW("Data set "<<index<<" has data type "<<h4_typename(meta.data_type)<<", expected numeric data");
+			}
+		}
+	}
 };
 
-my_dtype h5t_to_my(hid_t dtype) {
-	// tedious task to ask for type identity
-	if (H5Tequal(dtype, H5T_NATIVE_CHAR)) return MY_NATIVE_CHAR;
-	if (H5Tequal(dtype, H5T_NATIVE_SHORT)) return MY_NATIVE_SHORT;
-	if (H5Tequal(dtype, H5T_NATIVE_INT)) return MY_NATIVE_INT;
-	if (H5Tequal(dtype, H5T_NATIVE_LONG)) return MY_NATIVE_LONG;
-	if (H5Tequal(dtype, H5T_NATIVE_LLONG)) return MY_NATIVE_LLONG;
-	if (H5Tequal(dtype, H5T_NATIVE_UCHAR)) return MY_NATIVE_UCHAR;
+// payload size of an SDS and the estimated memory after reading it into a list
+static size_t sds_bytes(const sds_meta& meta) {
+	size_t n = 1;
+	for (int d = 0; d < meta.rank; d++) n *= meta.dims[d];
+	return n * DFKNTsize(meta.data_type);
+}
+
+static size_t sds_memory(const sds_meta& meta) {
+	size_t bytes = sds_bytes(meta);
+	if (meta.data_type == DFNT_CHAR8) return bytes + object_overhead;
+	size_t n = bytes / DFKNTsize(meta.data_type);
+	return bytes + n*element_overhead + object_overhead;
+}
+
+static SWObject readdata4_internal(int32 sds_id, const sds_meta& meta, int32 index) {
+	sds_slab slab;
+	eval_sds_slab(meta, SWList(), SWList(), SWList(), slab, index);
+	return readslab4_internal(sds_id, slab, meta, false, index);
+}
+
+SWObject HDFpp::readdata(size_t index) { 
+	perf_scope pscope(perf);
+    if (index>=ndatasets) STHROW("Only "<<ndatasets<<" data sets available, requested nr "<<index);
+	ensure_sdstable();
+    int32 sds_id;
+    
+    if ((sds_id=SDselect(hdf_id, index))==FAIL) {
+        STHROW("Can't select data set nr. "<<index);
+    }
+    
+    sds_release srelease(sds_id);
+
+	return readdata4_internal(sds_id, sdstable[index], index);
+}
+
+SWObject HDFpp::readslab(size_t index, const SWList& start, const SWList& edge, const SWList& stride) { 
+	perf_scope pscope(perf);
+    if (index>=ndatasets) STHROW("Only "<<ndatasets<<" data sets available, requested nr "<<index);
+	ensure_sdstable();
+    int32 sds_id;
+    
+    if ((sds_id=SDselect(hdf_id, index))==FAIL) {
+        STHROW("Can't select data set nr. "<<index);
+    }
+    
+    sds_release srelease(sds_id);
+
+	sds_slab slab;
+	eval_sds_slab(sdstable[index], start, edge, stride, slab, index);
+	return readslab4_internal(sds_id, slab, sdstable[index], false, index);
+}
+
+SWObject HDFpp::readpacked(size_t index, const SWList& start, const SWList& edge, const SWList& stride) { 
+	perf_scope pscope(perf);
+    if (index>=ndatasets) STHROW("Only "<<ndatasets<<" data sets available, requested nr "<<index);
+	ensure_sdstable();
+    int32 sds_id;
+    
+    if ((sds_id=SDselect(hdf_id, index))==FAIL) {
+        STHROW("Can't select data set nr. "<<index);
+    }
+    
+    sds_release srelease(sds_id);
+
+	sds_slab slab;
+	eval_sds_slab(sdstable[index], start, edge, stride, slab, index);
+	return readslab4_internal(sds_id, slab, sdstable[index], true, index);
+}
+
+SWDict HDFpp::decimate(size_t index, size_t nbuckets, const string& mode, long first, long last) {
+    if (index>=ndatasets) STHROW("Only "<<ndatasets<<" data sets available, requested nr "<<index);
+	ensure_sdstable();
+	h4_column_reader reader(hdf_id, sdstable[index], index);
+	return decimate_internal(reader, NULL, nbuckets, mode, first, last);
+}
+
+SWDict HDFpp::stats(size_t index) {
+    if (index>=ndatasets) STHROW("Only "<<ndatasets<<" data sets available, requested nr "<<index);
+	ensure_sdstable();
+	h4_column_reader reader(hdf_id, sdstable[index], index);
+	return stats_internal(reader);
+}
+
+Cursor *HDFpp::open_dataset(size_t index) {
+    if (index>=ndatasets) STHROW("Only "<<ndatasets<<" data sets available, requested nr "<<index);
+	ensure_sdstable();
+	// the HDF4 library is not thread safe, no read-ahead
+	return new Cursor(new h4_column_reader(hdf_id, sdstable[index], index), false);
+}
+
+SWList HDFpp::readdata_batch(const SWList& items) {
+	perf_scope pscope(perf);
+	SWList result;
+	sds_batch batch(hdf_id);
+	for (size_t i = 0; i < items.size(); i++) {
+		size_t index = resolve(items, i);
+		result.push_back(readdata4_internal(batch.select(index), sdstable[index], index));
+	}
+	return result;
+}
+
+
+// SDreadattr, accounted as I/O
+static intn readattr4_values(int32 sds_id, int32 i, int32 data_type, int32 count, void *buf) {
+	PERF_COUNT(attributes, 1);
+	PERF_COUNT(created, 1);
+	PERF_COUNT(bytes, count*DFKNTsize(data_type));
+	perf_timer timer(&perf_counters::t_io);
+	return SDreadattr(sds_id, i, buf);
+}
+
+static SWDict readattr4_internal(int32 sds_id, int32 num_attrs, int32 dset_index) {
+	SWDict result;
+
+    for (int i=0; i<num_attrs; i++) {
+	
+		char attr_name[64]; int32 data_type; int32 count;
+		if (SDattrinfo(sds_id, i, attr_name, &data_type, &count)==FAIL) {
+			STHROW("Error getting information on attribute "<<i<<", dataset "<<dset_index);
+		}
+
+		switch (data_type) {
+			case DFNT_FLOAT32: {
+				vector<float> buf(count);
+				if (readattr4_values(sds_id, i, data_type, count, &(buf[0])) == FAIL) {
+					STHROW("Error reading 32 bit float values from attribute "<<i<<", dataset "<<dset_index);
+				}
+
+				if (count == 1) {
+					result.insert(attr_name, buf[0]);
+				} else {
+					result.insert(attr_name, SWList(buf));
+				}
+				break;
+			}
+
+
+			case DFNT_FLOAT64: {
+				vector<double> buf(count);
+				if (readattr4_values(sds_id, i, data_type, count, &(buf[0])) == FAIL) {
+					STHROW("Error reading 64 bit float values from attribute "<<i<<", dataset "<<dset_index);
+				}
+
+				if (count == 1) {
+					result.insert(attr_name, buf[0]);
+				} else {
+					result.insert(attr_name, SWList(buf));
+				}
+
+				break;
+			}
+
+			case DFNT_INT32: {
+				vector<int32> buf(count);
+				if (readattr4_values(sds_id, i, data_type, count, &(buf[0])) == FAIL) {
+					STHROW("Error reading 32 bit int values from attribute "<<i<<", dataset "<<dset_index);
+				}
+				
+				if (count == 1) {
+					result.insert(attr_name, buf[0]);
+				} else {
+					result.insert(attr_name, SWList(buf));
+				}
+				
+				break;
+			}
+
+			case DFNT_CHAR8: {
+				vector<char> buf(count);
+				if (readattr4_values(sds_id, i, data_type, count, &(buf[0])) == FAIL) {
+					STHROW("Error reading char values (string) from attribute "<<i<<", dataset "<<dset_index);
+				}
+				
+				result.insert(attr_name, string(&(buf[0]), count));
+				
+				break;
+
+
+			}
+
+			default: {
+				STHROW("Attribute "<<i<<" of data set "<<dset_index<<" has data type "<<data_type<<" can only read 64bit float, 32bit int and string (char8)");
+			}
+		}
+	}
+
+	return result;
+}
+
+
+SWDict HDFpp::readattrs(size_t index) { 
+	perf_scope pscope(perf);
+    if (index>=ndatasets) STHROW("Only "<<ndatasets<<" data sets available, requested nr "<<index);
+	ensure_sdstable();
+    int32 sds_id;
+    
+    if ((sds_id=SDselect(hdf_id, index))==FAIL) {
+        STHROW("Can't select data set nr. "<<index);
+    }
+    
+    sds_release srelease(sds_id);
+
+    return readattr4_internal(sds_id, sdstable[index].num_attrs, index);
+}
+
+SWList HDFpp::readattrs_batch(const SWList& items) {
+	perf_scope pscope(perf);
+	SWList result;
+	sds_batch batch(hdf_id);
+	for (size_t i = 0; i < items.size(); i++) {
+		size_t index = resolve(items, i);
+		result.push_back(readattr4_internal(batch.select(index), sdstable[index].num_attrs, index));
+	}
+	return result;
+}
+
+SWDict HDFpp::readglobalattrs() {
+	perf_scope pscope(perf);
+	// reading global attributes is implemented
+	// by reading the attributes from the hdf_id
+	return readattr4_internal(hdf_id, nglobal_attrs, -1);
+	// -1 is just a fudge value, only for the error messages
+}
+
+
+SWObject HDFpp::dump() {
+	perf_scope pscope(perf);
+	budget_scope bscope(budget);
+	// dump the data sets as one big dictionary
+	SWList result;
+	if (nglobal_attrs != 0) {
+		// if we have global attributes, insert them as a first dataset
+		// with an empty name
+		SWDict entry;
+		SWDict attrs = readglobalattrs();
+		SWList data; // empty list
+		entry.insert("name", string());
+		entry.insert("attrs", attrs);
+		entry.insert("data", data);
+		result.push_back(entry);
+	}
+	ensure_sdstable();
+	for (size_t index = 0; index < get_num_datasets(); index++) {
+		const sds_meta &meta = sdstable[index];
+		
+		int32 sds_id;
+		if ((sds_id=SDselect(hdf_id, index))==FAIL) {
+			STHROW("Can't select data set nr. "<<index);
+		}
+    
+		sds_release srelease(sds_id);
+		PERF_COUNT(objects, 1);
+		
+		SWDict entry; 
+		SWDict attrs = readattr4_internal(sds_id, meta.num_attrs, index);
+		entry.insert("name", meta.name);
+		entry.insert("attrs", attrs);
+		size_t memory = sds_memory(meta);
+		if (budget_active && !budget_active->take(memory)) {
+			// over the budget: placeholder and a preview of 1D data
+			unique_ptr<column_reader> reader;
+			if (meta.rank == 1) reader.reset(new h4_column_reader(hdf_id, meta, index));
+			entry.insert("data", SWList());
+			entry.insert("skipped", skipped_data(memory, reader.get()));
+		} else {
+			entry.insert("data", readdata4_internal(sds_id, meta, index));
+		}
+		result.push_back(entry);
+	}
+	return result;
+}
+
+// JSON export of HDF4 attributes, same types as readattr4_internal
+template <typename T, typename TOUT>
+static void json_attr4_values(json_writer& w, int32 sds_id, int32 i, int32 count, int32 dset_index) {
+	vector<T> buf(count);
+	if (count > 0 && SDreadattr(sds_id, i, &buf[0]) == FAIL) {
+		STHROW("Error reading values from attribute "<<i<<", dataset "<<dset_index);
+	}
+	if (count == 1) {
+		w.number(static_cast<TOUT>(buf[0]));
+		return;
+	}
+	w.put('[');
+	for (int32 k = 0; k < count; k++) {
+		if (k > 0) w.put(',');
+		w.number(static_cast<TOUT>(buf[k]));
+	}
+	w.put(']');
+}
+
+static void json_attrs4(json_writer& w, int32 sds_id, int32 num_attrs, int32 dset_index) {
+	w.key("attrs");
+	w.put('{');
+	for (int i=0; i<num_attrs; i++) {
+		char attr_name[64]; int32 data_type; int32 count;
+		if (SDattrinfo(sds_id, i, attr_name, &data_type, &count)==FAIL) {
+			STHROW("Error getting information on attribute "<<i<<", dataset "<<dset_index);
+		}
+		if (i > 0) w.put(',');
+		w.key(attr_name);
+
+		switch (data_type) {
+			case DFNT_FLOAT32: json_attr4_values<float32, double>(w, sds_id, i, count, dset_index); break; 
+			case DFNT_FLOAT64: json_attr4_values<float64, double>(w, sds_id, i, count, dset_index); break;
+			case DFNT_INT32: json_attr4_values<int32, long long>(w, sds_id, i, count, dset_index); break;
+			case DFNT_CHAR8: {
+				vector<char> buf(count);
+				if (count > 0 && SDreadattr(sds_id, i, &buf[0]) == FAIL) {
+					STHROW("Error reading char values (string) from attribute "<<i<<", dataset "<<dset_index);
+				}
+				w.string(count > 0 ? &buf[0] : "", count);
+				break;
+			}
+			default: {
+				STHROW("Attribute "<<i<<" of data set "<<dset_index<<" has data type "<<data_type<<" can only read 64bit float, 32bit int and string (char8)");
+			}
+		}
+	}
+	w.put('}');
+}
+
+template <typename T, typename TOUT>
+static void json_data4_values(json_writer& w, int32 sds_id, const sds_meta& meta, int32 index) {
+	// streamed in slabs along the first dimension
+	sds_slab slab;
+	eval_sds_slab(meta, SWList(), SWList(), SWList(), slab, index);
+	w.put('[');
+	if (slab.nelements > 0) {
+		size_t rowsize = slab.nelements / meta.dims[0];
+		size_t rows = max<size_t>(1, streamblock / max<size_t>(1, rowsize));
+		vector<T> buf;
+		bool first = true;
+		for (long r = 0; r < meta.dims[0]; r += rows) {
+			slab.start[0] = r;
+			slab.edge[0] = min<long>(rows, meta.dims[0] - r);
+			slab.nelements = slab.edge[0] * rowsize;
+			readslab4_typed(sds_id, slab, buf, index);
+			for (size_t i = 0; i < buf.size(); i++) {
+				if (!first) w.put(',');
+				first = false;
+				w.number(static_cast<TOUT>(buf[i]));
+			}
+		}
+	}
+	w.put(']');
+}
+
+static void json_data4(json_writer& w, int32 sds_id, const sds_meta& meta, int32 index) {
+	switch (meta.data_type) {
+		case DFNT_FLOAT64: json_data4_values<float64, double>(w, sds_id, meta, index); break;
+		case DFNT_FLOAT32: json_data4_values<float32, double>(w, sds_id, meta, index); break;
+		case DFNT_INT8: json_data4_values<int8, long long>(w, sds_id, meta, index); break;
+		case DFNT_UINT8: 
+		case DFNT_UCHAR8: json_data4_values<uint8, long long>(w, sds_id, meta, index); break;
+		case DFNT_INT16: json_data4_values<int16, long long>(w, sds_id, meta, index); break;
+		case DFNT_UINT16: json_data4_values<uint16, long long>(w, sds_id, meta, index); break;
+		case DFNT_INT32: json_data4_values<int32, long long>(w, sds_id, meta, index); break;
+		case DFNT_UINT32: json_data4_values<uint32, long long>(w, sds_id, meta, index); break;
+		case DFNT_CHAR8: {
+			// text stored as an SDS
+			sds_slab slab;
+			eval_sds_slab(meta, SWList(), SWList(), SWList(), slab, index);
+			vector<char8> buf;
+			readslab4_typed(sds_id, slab, buf, index);
+			w.string(buf.empty() ? "" : reinterpret_cast<const char*>(&buf[0]), buf.size());
+			break;
+		}
+		default: {
+			STHROW("Data set "<<index<<" has unsupported data type "<<meta.data_type);
+		}
+	}
+}
+
+void HDFpp::writejson(const char *fname, const string& format) {
+	// the same list of entries as dump, as a JSON array or one entry per line
+	bool ndjson;
+	if (format == "json") ndjson = false;
+	else if (format == "ndjson") ndjson = true;
+	else STHROW("Unknown format "<<format<<", must be json or ndjson");
+
+	ensure_sdstable();
+	json_writer w(fname);
+	const char *separator = ndjson ? "\n" : ",";
+	bool first = true;
+	if (!ndjson) w.put('[');
+	if (nglobal_attrs != 0) {
+		w.put('{');
+		w.key("name");
+		w.put("\"\",", 3);
+		json_attrs4(w, hdf_id, nglobal_attrs, -1);
+		w.put(',');
+		w.key("data");
+		w.put("[]}", 3);
+		first = false;
+	}
+	for (size_t index = 0; index < get_num_datasets(); index++) {
+		const sds_meta &meta = sdstable[index];
+		
+		int32 sds_id;
+		if ((sds_id=SDselect(hdf_id, index))==FAIL) {
+			STHROW("Can't select data set nr. "<<index);
+		}
+		sds_release srelease(sds_id);
+
+		if (!first) w.put(separator);
+		first = false;
+		w.put('{');
+		w.key("name");
+		w.string(meta.name);
+		w.put(',');
+		json_attrs4(w, sds_id, meta.num_attrs, index);
+		w.put(',');
+		w.key("data");
+		json_data4(w, sds_id, meta, index);
+		w.put('}');
+	}
+	if (!ndjson) w.put(']');
+	w.put('\n');
+	w.close();
+}
+
+// rows of an SDS in the native type
+class h4_export_source : public export_source {
+	int32 sds_id;
+	int32 data_type;
+public:
+	h4_export_source(int32 hdf_id, const sds_meta& meta, int32 index) : sds_id(FAIL), data_type(meta.data_type) {
+		string dtype = meta.data_type == DFNT_UCHAR8 ? "uint8" : h4_typename(meta.data_type);
+		if (column_elsize(dtype) == 0) STHROW("Data set "<<meta.name<<" has data type "<<dtype<<", expected numeric data");
+		if ((sds_id = SDselect(hdf_id, index)) == FAIL) STHROW("Can't select data set nr. "<<index);
+		path = meta.name;
+		shape.assign(meta.dims.begin(), meta.dims.end());
+		recsize = column_elsize(dtype);
+		columns.push_back(column{ meta.name, dtype, 0 });
+	}
+
+	~h4_export_source() {
+		SDendaccess(sds_id);
+	}
+
+	void read(size_t row, size_t nrows, char *out) {
+		vector<int32> start(shape.size(), 0), edge(shape.begin(), shape.end());
+		start[0] = row;
+		edge[0] = nrows;
+		if (SDreaddata(sds_id, &start[0], NULL, &edge[0], out) == FAIL) {
+			STHROW("Error reading data set "<<path);
+		}
+		PERF_COUNT(bytes, nrows*rowsize()*DFKNTsize(data_type));
+	}
+};
+
+SWList HDFpp::writecolumns(const char *fname, const SWList& datasets, const string& format) {
+	export_check_format(format);
+	perf_scope scope(perf);
+	vector< unique_ptr<export_source> > sources;
+	for (size_t i = 0; i < datasets.size(); i++) {
+		size_t index = resolve(datasets, i);
+		sources.push_back(unique_ptr<export_source>(new h4_export_source(hdf_id, sdstable[index], index)));
+	}
+	return export_columns(sources, fname, format);
+}
+
+void HDFpp::profile(bool enable) {
+	perf.enabled = enable;
+}
+
+SWDict HDFpp::estimate() {
+	ensure_sdstable();
+	size_t attributes = nglobal_attrs, bytes = 0, memory = 0, largest = 0;
+	string largestname;
+	for (size_t index = 0; index < ndatasets; index++) {
+		const sds_meta &meta = sdstable[index];
+		attributes += meta.num_attrs;
+		bytes += sds_bytes(meta);
+		size_t m = sds_memory(meta);
+		memory += m;
+		if (m > largest || largestname.empty()) {
+			largest = m;
+			largestname = meta.name;
+		}
+	}
+	memory += attributes*object_overhead;
+
+	SWDict result;
+	result.insert("objects", ndatasets);
+	result.insert("datasets", ndatasets);
+	result.insert("attributes", attributes);
+	result.insert("bytes", bytes);
+	result.insert("memory", memory);
+	result.insert("largest", largestname);
+	result.insert("largest_memory", largest);
+	return result;
+}
+
+void HDFpp::memory_budget(size_t maxbytes) {
+	budget = maxbytes;
+}
+
+SWDict HDFpp::perfstats(const string& action) {
+	return perfstats_internal(perf, action);
+}
+
+#ifdef HAVE_HDF5
+// Background prefetch of new scan files. A watcher thread (inotify, Linux only)
+// queues files which are closed after writing or moved into the watched
+// directories, and a limited number of worker threads with low priority
+// read them completely into memory. H5pp reads a prefetched file from the
+// in-memory image through the blockcache driver, if its size and
+// modification time are unchanged.
+// The background threads do plain file reads only, such that neither HDF5
+// nor Tcl need to be thread safe.
+struct prefetch_image {
+	// shared with the open files, which keep it when it is evicted
+	shared_ptr<const vector<char> > data;
+	long long size;
+	long long mtime;
+	unsigned long long lastuse;
+};
+
+struct prefetch_state {
+	mutex lock;
+	condition_variable wakeup;
+	map<string, prefetch_image> images;
+	deque<string> queue;
+	size_t budget;
+	size_t maxfile;
+	size_t maxworkers;
+	size_t active;
+	unsigned long long clock;
+	unsigned long long hits;
+	unsigned long long misses;
+	bool stop;
+	vector<thread> workers;
+	// watched directory by inotify watch descriptor
+	map<int, string> watches;
+	int notify;
+	thread watcher;
+
+	prefetch_state() : budget(size_t(256) << 20), maxfile(0), maxworkers(1), active(0),
+		clock(0), hits(0), misses(0), stop(false), notify(-1) { }
+
+	~prefetch_state() {
+		{
+			lock_guard<mutex> guard(lock);
+			stop = true;
+		}
+		wakeup.notify_all();
+		for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+		if (watcher.joinable()) watcher.join();
+#ifdef __linux__
+		if (notify >= 0) ::close(notify);
+#endif
+	}
+};
+
+static prefetch_state& prefetch() {
+	static prefetch_state state;
+	return state;
+}
+
+// absolute path, such that the watcher and the caller agree on the name
+static string prefetch_key(const string& fname) {
+#ifndef _WIN32
+	char *full = realpath(fname.c_str(), NULL);
+#else
+	char *full = _fullpath(NULL, fname.c_str(), 0);
+#endif
+	if (!full) return fname;
+	string result(full);
+	free(full);
+	return result;
+}
+
+static bool prefetch_stat(const string& fname, long long& size, long long& mtime) {
+	struct stat st;
+	if (stat(fname.c_str(), &st) != 0) return false;
+	size = st.st_size;
+	mtime = st.st_mtime;
+	return true;
+}
+
+// HDF5 signature at offset 0, 512, 1024, 2048, ... (after a user block)
+static bool prefetch_is_hdf5(const vector<char>& data) {
+	static const char signature[] = "\211HDF\r\n\032\n";
+	for (size_t offset = 0; offset + 8 <= data.size(); offset = offset ? 2*offset : 512) {
+		if (memcmp(&data[offset], signature, 8) == 0) return true;
+	}
+	return false;
+}
+
+// evict least recently used images until the budget is met, called with the lock held
+static void prefetch_evict(prefetch_state& pf) {
+	size_t total = 0;
+	for (map<string, prefetch_image>::iterator it = pf.images.begin(); it != pf.images.end(); ++it) {
+		total += it->second.data->size();
+	}
+	while (total > pf.budget && !pf.images.empty()) {
+		map<string, prefetch_image>::iterator lru = pf.images.begin();
+		for (map<string, prefetch_image>::iterator it = pf.images.begin(); it != pf.images.end(); ++it) {
+			if (it->second.lastuse < lru->second.lastuse) lru = it;
+		}
+		total -= lru->second.data->size();
+		pf.images.erase(lru);
+	}
+}
+
+static void prefetch_read(prefetch_state& pf, const string& fname) {
+	prefetch_image image;
+	long long size, mtime;
+	if (!prefetch_stat(fname, image.size, image.mtime)) return;
+	{
+		lock_guard<mutex> guard(pf.lock);
+		size_t limit = pf.maxfile > 0 ? min(pf.maxfile, pf.budget) : pf.budget;
+		if (image.size <= 0 || static_cast<unsigned long long>(image.size) > limit) return;
+		map<string, prefetch_image>::iterator it = pf.images.find(fname);
+		if (it != pf.images.end() && it->second.size == image.size && it->second.mtime == image.mtime) return;
+	}
+
+	FILE *in = fopen(fname.c_str(), "rb");
+	if (!in) return;
+	shared_ptr<vector<char> > data(new vector<char>(image.size));
+	size_t nread = fread(&(*data)[0], 1, data->size(), in);
+	fclose(in);
+	// skip files which are still being written
+	if (nread != data->size() || !prefetch_stat(fname, size, mtime) || size != image.size || mtime != image.mtime) return;
+	if (!prefetch_is_hdf5(*data)) return;
+
+	lock_guard<mutex> guard(pf.lock);
+	image.data = data;
+	image.lastuse = ++pf.clock;
+	pf.images[fname] = image;
+	prefetch_evict(pf);
+}
+
+static void prefetch_worker(prefetch_state& pf) {
+#ifdef __linux__
+	// idle CPU and I/O priority for this thread only
+	setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+#ifdef SYS_ioprio_set
+	syscall(SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, 0, 3 << 13 /* IOPRIO_CLASS_IDLE */);
+#endif
+#endif
+	unique_lock<mutex> guard(pf.lock);
+	while (true) {
+		pf.wakeup.wait(guard, [&pf]() { return pf.stop || (!pf.queue.empty() && pf.active < pf.maxworkers); });
+		if (pf.stop) return;
+		string fname = pf.queue.front();
+		pf.queue.pop_front();
+		pf.active++;
+		guard.unlock();
+		try {
+			prefetch_read(pf, fname);
+		} catch (const exception&) {
+			// e.g. out of memory, the file is opened normally later
+		}
+		guard.lock();
+		pf.active--;
+		pf.wakeup.notify_all();
+	}
+}
+
+// queue a file, called with the lock held
+static void prefetch_enqueue(prefetch_state& pf, const string& fname) {
+	if (find(pf.queue.begin(), pf.queue.end(), fname) != pf.queue.end()) return;
+	pf.queue.push_back(fname);
+	while (pf.workers.size() < pf.maxworkers) pf.workers.push_back(thread(prefetch_worker, ref(pf)));
+	pf.wakeup.notify_all();
+}
+
+#ifdef __linux__
+static void prefetch_watcher(prefetch_state& pf) {
+	vector<char> buf(65536);
+	while (true) {
+		struct pollfd pfd;
+		pfd.fd = pf.notify;
+		pfd.events = POLLIN;
+		// the timeout lets the thread notice the shutdown
+		int ready = poll(&pfd, 1, 200);
+		lock_guard<mutex> guard(pf.lock);
+		if (pf.stop) return;
+		if (ready <= 0) continue;
+		ssize_t len = read(pf.notify, &buf[0], buf.size());
+		for (ssize_t pos = 0; pos < len; ) {
+			const struct inotify_event *ev = reinterpret_cast<const struct inotify_event*>(&buf[pos]);
+			pos += sizeof(struct inotify_event) + ev->len;
+			map<int, string>::iterator dir = pf.watches.find(ev->wd);
+			if (ev->len == 0 || dir == pf.watches.end() || (ev->mask & IN_ISDIR)) continue;
+			prefetch_enqueue(pf, dir->second + "/" + ev->name);
+		}
+	}
+}
+#endif
+
+void prefetch_watch(const string& dir) {
+#ifdef __linux__
+	prefetch_state& pf = prefetch();
+	string path = prefetch_key(dir);
+	lock_guard<mutex> guard(pf.lock);
+	if (pf.notify < 0) {
+		pf.notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (pf.notify < 0) STHROW("Can't initialize inotify: "<<strerror(errno));
+	}
+	// only complete files: closed after writing, or renamed into the directory
+	int wd = inotify_add_watch(pf.notify, path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR);
+	if (wd < 0) STHROW("Can't watch "<<dir<<": "<<strerror(errno));
+	pf.watches[wd] = path;
+	if (!pf.watcher.joinable()) pf.watcher = thread(prefetch_watcher, ref(pf));
+#else
+	STHROW("Watching directories is only supported on Linux, use prefetch_file");
+#endif
+}
+
+void prefetch_unwatch(const string& dir) {
+	prefetch_state& pf = prefetch();
+	string path = prefetch_key(dir);
+	lock_guard<mutex> guard(pf.lock);
+	for (map<int, string>::iterator it = pf.watches.begin(); it != pf.watches.end(); ++it) {
+		if (it->second != path) continue;
+#ifdef __linux__
+		inotify_rm_watch(pf.notify, it->first);
+#endif
+		pf.watches.erase(it);
+		return;
+	}
+	STHROW("Directory "<<dir<<" is not watched");
+}
+
+void prefetch_file(const string& fname) {
+	prefetch_state& pf = prefetch();
+	string path = prefetch_key(fname);
+	lock_guard<mutex> guard(pf.lock);
+	prefetch_enqueue(pf, path);
+}
+
+void prefetch_config(size_t maxbytes, size_t maxfile, size_t workers) {
+	if (workers == 0) STHROW("Number of workers must be positive");
+	prefetch_state& pf = prefetch();
+	lock_guard<mutex> guard(pf.lock);
+	pf.budget = maxbytes;
+	pf.maxfile = maxfile;
+	pf.maxworkers = workers;
+	prefetch_evict(pf);
+	if (!pf.queue.empty()) {
+		while (pf.workers.size() < pf.maxworkers) pf.workers.push_back(thread(prefetch_worker, ref(pf)));
+	}
+	pf.wakeup.notify_all();
+}
+
+SWDict prefetch_stats(bool wait) {
+	prefetch_state& pf = prefetch();
+	unique_lock<mutex> guard(pf.lock);
+	if (wait) pf.wakeup.wait(guard, [&pf]() { return pf.queue.empty() && pf.active == 0; });
+	size_t bytes = 0;
+	SWList files;
+	for (map<string, prefetch_image>::iterator it = pf.images.begin(); it != pf.images.end(); ++it) {
+		bytes += it->second.data->size();
+		files.push_back(it->first);
+	}
+	SWList dirs;
+	for (map<int, string>::iterator it = pf.watches.begin(); it != pf.watches.end(); ++it) {
+		dirs.push_back(it->second);
+	}
+	SWDict result;
+	result.insert("files", files);
+	result.insert("bytes", bytes);
+	result.insert("queued", pf.queue.size() + pf.active);
+	result.insert("hits", pf.hits);
+	result.insert("misses", pf.misses);
+	result.insert("watched", dirs);
+	return result;
+}
+
+void prefetch_clear() {
+	prefetch_state& pf = prefetch();
+	lock_guard<mutex> guard(pf.lock);
+	pf.images.clear();
+}
+
+// the prefetched image of fname, if it is up to date
+static shared_ptr<const vector<char> > prefetch_lookup(const char *fname) {
+	prefetch_state& pf = prefetch();
+	lock_guard<mutex> guard(pf.lock);
+	if (pf.images.empty() && pf.watches.empty()) return shared_ptr<const vector<char> >();
+	string path = prefetch_key(fname);
+	long long size, mtime;
+	map<string, prefetch_image>::iterator it = pf.images.find(path);
+	if (it == pf.images.end() || !prefetch_stat(path, size, mtime) || size != it->second.size || mtime != it->second.mtime) {
+		if (it != pf.images.end()) pf.images.erase(it);
+		pf.misses++;
+		return shared_ptr<const vector<char> >();
+	}
+	it->second.lastuse = ++pf.clock;
+	pf.hits++;
+	return it->second.data;
+}
+
+// Read-only file driver for files on network file systems, where every
+// read is a round trip. The file is read in aligned blocks, which are kept
+// in an LRU cache per file, and sequential reads fetch several blocks ahead.
+// Large reads of raw data bypass the cache. Files prefetched into memory
+// are read from the image instead.
+static size_t blockcache_blocksize = 65536;
+static size_t blockcache_nblocks = 256;
+static size_t blockcache_readahead = 16;
+// artificial delay per read from the file, to simulate a network file system
+static double blockcache_delay = 0.0;
+// prefetched image for the file being opened by this thread, which is read instead of the file
+static thread_local const shared_ptr<const vector<char> > *blockcache_pending = NULL;
+
+struct blockcache_file {
+	H5FD_t pub; // filled by HDF5, must be the first member
+	int fd;
+	shared_ptr<const vector<char> > image;
+	string name;
+	haddr_t eoa;
+	haddr_t eof;
+	// block number -> data, and the block numbers, most recently used first
+	unordered_map<haddr_t, pair<vector<char>, list<haddr_t>::iterator> > blocks;
+	list<haddr_t> lru;
+	haddr_t lastmiss;
+	size_t streak;
+	// settings at the time of opening, changes apply to files opened later
+	size_t blocksize;
+	size_t nblocks;
+	size_t readahead;
+};
+
+// read up to size bytes at offset, the rest past the end of the file is zero
+static bool blockcache_pread(int fd, char *buf, size_t size, haddr_t offset) {
+	if (blockcache_delay > 0) this_thread::sleep_for(chrono::duration<double>(blockcache_delay));
+	size_t done = 0;
+	while (done < size) {
+#ifndef _WIN32
+		ssize_t n = pread(fd, buf + done, size - done, offset + done);
+#else
+		if (_lseeki64(fd, offset + done, SEEK_SET) < 0) return false;
+		int n = _read(fd, buf + done, static_cast<unsigned>(min<size_t>(size - done, 1 << 30)));
+#endif
+		if (n < 0) return false;
+		if (n == 0) break;
+		done += n;
+	}
+	memset(buf + done, 0, size - done);
+	return true;
+}
+
+static H5FD_t *blockcache_open(const char *name, unsigned flags, hid_t, haddr_t) {
+	if (flags & (H5F_ACC_RDWR | H5F_ACC_CREAT | H5F_ACC_TRUNC)) return NULL;
+	if (blockcache_pending) {
+		blockcache_file *file = new blockcache_file();
+		file->fd = -1;
+		file->image = *blockcache_pending;
+		file->name = name;
+		file->eoa = 0;
+		file->eof = file->image->size();
+		file->lastmiss = HADDR_UNDEF;
+		file->streak = 0;
+		file->blocksize = blockcache_blocksize;
+		file->nblocks = blockcache_nblocks;
+		file->readahead = blockcache_readahead;
+		return &file->pub;
+	}
+#ifndef _WIN32
+	int fd = open(name, O_RDONLY);
+	struct stat st;
+	if (fd < 0) return NULL;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return NULL;
+	}
+#else
+	int fd = _open(name, _O_RDONLY | _O_BINARY);
+	struct _stati64 st;
+	if (fd < 0) return NULL;
+	if (_fstati64(fd, &st) != 0) {
+		_close(fd);
+		return NULL;
+	}
+#endif
+	blockcache_file *file = new blockcache_file();
+	file->fd = fd;
+	file->name = name;
+	file->eoa = 0;
+	file->eof = st.st_size;
+	file->lastmiss = HADDR_UNDEF;
+	file->streak = 0;
+	file->blocksize = blockcache_blocksize;
+	file->nblocks = blockcache_nblocks;
+	file->readahead = blockcache_readahead;
+	return &file->pub;
+}
+
+static herr_t blockcache_close(H5FD_t *pub) {
+	blockcache_file *file = reinterpret_cast<blockcache_file*>(pub);
+#ifndef _WIN32
+	if (file->fd >= 0) close(file->fd);
+#else
+	if (file->fd >= 0) _close(file->fd);
+#endif
+	delete file;
+	return 0;
+}
+
+static int blockcache_cmp(const H5FD_t *f1, const H5FD_t *f2) {
+	return reinterpret_cast<const blockcache_file*>(f1)->name.compare(reinterpret_cast<const blockcache_file*>(f2)->name);
+}
+
+static herr_t blockcache_query(const H5FD_t *, unsigned long *flags) {
+	// the same as sec2
+	*flags = H5FD_FEAT_AGGREGATE_METADATA | H5FD_FEAT_ACCUMULATE_METADATA | H5FD_FEAT_DATA_SIEVE | H5FD_FEAT_AGGREGATE_SMALLDATA;
+	return 0;
+}
+
+static haddr_t blockcache_get_eoa(const H5FD_t *pub, H5FD_mem_t) {
+	return reinterpret_cast<const blockcache_file*>(pub)->eoa;
+}
+
+static herr_t blockcache_set_eoa(H5FD_t *pub, H5FD_mem_t, haddr_t addr) {
+	reinterpret_cast<blockcache_file*>(pub)->eoa = addr;
+	return 0;
+}
+
+static haddr_t blockcache_get_eof(const H5FD_t *pub, H5FD_mem_t) {
+	return reinterpret_cast<const blockcache_file*>(pub)->eof;
+}
+
+static herr_t blockcache_get_handle(H5FD_t *pub, hid_t, void **handle) {
+	*handle = &reinterpret_cast<blockcache_file*>(pub)->fd;
+	return 0;
+}
+
+// the cached block, read from the file on a miss
+static const vector<char> *blockcache_get(blockcache_file *file, haddr_t block) {
+	size_t bs = file->blocksize;
+	auto it = file->blocks.find(block);
+	if (it != file->blocks.end()) {
+		file->lru.splice(file->lru.begin(), file->lru, it->second.second);
+		return &it->second.first;
+	}
+
+	// consecutive misses double the read-ahead up to the limit
+	file->streak = (file->lastmiss != HADDR_UNDEF && block == file->lastmiss + 1) ? file->streak + 1 : 0;
+	size_t nread = 1;
+	if (file->streak > 0) nread = min<size_t>(file->readahead, size_t(1) << min<size_t>(file->streak, 16));
+	nread = max<size_t>(1, min(nread, file->nblocks));
+	haddr_t lastblock = (file->eof + bs - 1) / bs;
+	if (block + nread > lastblock) nread = max<haddr_t>(1, lastblock - block);
+
+	vector<char> buf(nread * bs);
+	if (!blockcache_pread(file->fd, &buf[0], buf.size(), block * bs)) return NULL;
+	file->lastmiss = block + nread - 1;
+
+	for (size_t i = 0; i < nread; i++) {
+		if (file->blocks.count(block + i)) continue;
+		file->lru.push_front(block + i);
+		pair<vector<char>, list<haddr_t>::iterator>& entry = file->blocks[block + i];
+		entry.first.assign(buf.begin() + i*bs, buf.begin() + (i+1)*bs);
+		entry.second = file->lru.begin();
+	}
+	while (file->lru.size() > file->nblocks && file->lru.back() != block) {
+		file->blocks.erase(file->lru.back());
+		file->lru.pop_back();
+	}
+	it = file->blocks.find(block);
+	file->lru.splice(file->lru.begin(), file->lru, it->second.second);
+	return &it->second.first;
+}
+
+static herr_t blockcache_read(H5FD_t *pub, H5FD_mem_t, hid_t, haddr_t addr, size_t size, void *buffer) {
+	blockcache_file *file = reinterpret_cast<blockcache_file*>(pub);
+	char *out = static_cast<char*>(buffer);
+	if (addr == HADDR_UNDEF || addr + size > file->eoa) return -1;
+
+	if (file->image) {
+		size_t avail = addr < file->image->size() ? min<size_t>(size, file->image->size() - addr) : 0;
+		if (avail > 0) memcpy(out, &(*file->image)[addr], avail);
+		memset(out + avail, 0, size - avail);
+		return 0;
+	}
+
+	size_t bs = file->blocksize;
+	if (file->nblocks == 0 || size >= bs * max<size_t>(file->readahead, 1)) {
+		return blockcache_pread(file->fd, out, size, addr) ? 0 : -1;
+	}
+
+	while (size > 0) {
+		const vector<char> *block = blockcache_get(file, addr / bs);
+		if (!block) return -1;
+		size_t offset = addr % bs;
+		size_t n = min(size, bs - offset);
+		memcpy(out, &(*block)[offset], n);
+		out += n;
+		addr += n;
+		size -= n;
+	}
+	return 0;
+}
+
+static herr_t blockcache_write(H5FD_t *, H5FD_mem_t, hid_t, haddr_t, size_t, const void *) {
+	// read-only
+	return -1;
+}
+
+static hid_t blockcache_driver() {
+	static hid_t driver = -1;
+	if (driver >= 0 && H5Iis_valid(driver) > 0) return driver;
+
+	static H5FD_class_t cls;
+	memset(&cls, 0, sizeof(cls));
+#ifdef H5FD_CLASS_VERSION
+	cls.version = H5FD_CLASS_VERSION;
+	// from the range for unregistered drivers
+	cls.value = static_cast<H5FD_class_value_t>(511);
+#endif
+	cls.name = "blockcache";
+	cls.maxaddr = HADDR_MAX;
+	cls.fc_degree = H5F_CLOSE_WEAK;
+	cls.open = blockcache_open;
+	cls.close = blockcache_close;
+	cls.cmp = blockcache_cmp;
+	cls.query = blockcache_query;
+	cls.get_eoa = blockcache_get_eoa;
+	cls.set_eoa = blockcache_set_eoa;
+	cls.get_eof = blockcache_get_eof;
+	cls.get_handle = blockcache_get_handle;
+	cls.read = blockcache_read;
+	cls.write = blockcache_write;
+	driver = H5FDregister(&cls);
+	return driver;
+}
+
+void blockcache_config(size_t blocksize, size_t nblocks, size_t readahead) {
+	if (blocksize == 0) STHROW("Block size must be positive");
+	// applies to files opened afterwards, open files keep their settings
+	blockcache_blocksize = blocksize;
+	blockcache_nblocks = nblocks;
+	blockcache_readahead = readahead;
+}
+
+void blockcache_latency(double seconds) {
+	blockcache_delay = seconds;
+}
+
+H5pp::H5pp(const char *fname, const string& driver) : file(-1), budget(0) {
+	// 1. Create a File Access Property List (FAPL)
+	hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
+	if (fapl >= 0) {
+		// 2. Disable file locking (use_file_locking = false, ignore_disabled_locks = true)
+		H5Pset_file_locking(fapl, false, true);
+		if (driver == "blockcache") {
+			H5Pset_driver(fapl, blockcache_driver(), NULL);
+		} else if (driver != "default") {
+			H5Pclose(fapl);
+			STHROW("Unknown driver "<<driver<<", must be default or blockcache");
+		}
+	}
+
+	// a prefetched file is read from memory by the blockcache driver
+	shared_ptr<const vector<char> > image;
+	if (fapl >= 0 && driver == "default") image = prefetch_lookup(fname);
+	if (image) H5Pset_driver(fapl, blockcache_driver(), NULL);
+	blockcache_pending = image ? &image : NULL;
+
+	// 3. Open the file passing our custom property list instead of H5P_DEFAULT
+	file = H5Fopen(fname, H5F_ACC_RDONLY, fapl);
+	blockcache_pending = NULL;
+
+	// 4. Close the property list handle to prevent resource leaks
+	if (fapl >= 0) {
+		H5Pclose(fapl);
+	}
+
+	if (file < 0) {
+		// can't read the file
+		STHROW("Can't open " << fname);
+	}
+}
+
+H5pp::~H5pp () { close(); }
+
+
+void H5pp::close() {
+	if (file >= 0) {
+		H5Fclose(file);
+		file = -1; // Reset to avoid dangling descriptor states
+	}
+}
+
+void readlink5_internal(hid_t loc_id, const char *name, const H5L_info_t* info, SWDict& linkdata);
+void readattr5_internal(hid_t loc_id, SWDict& attrs);
+void readdataset5_internal(hid_t loc_id, const char *name, SWDict& datasetdata);
+void readdatatype5_internal(hid_t loc_id, const char *name, SWDict& datatypedata);
+
+// command prefixes of the streaming dump, called with the path and the dict of the object
+struct walk_callbacks {
+	const SWCallback *ongroup;
+	const SWCallback *onleave;
+	const SWCallback *ondataset;
+	const SWCallback *onlink;
+};
+
+void readgroup5_recursive(hid_t loc_id, const char *name, SWDict& groupdump, int maxlevel, const walk_callbacks *walk = NULL, const string& path = "");
+
+SWObject H5pp::dump(int maxlevel, const char* root) {
+	perf_scope pscope(perf);
+	budget_scope bscope(budget);
+	SWDict result;
+	// read root group of HDF5
+	readgroup5_recursive(file, root, result, maxlevel);
+	return result;
+}
+
+void H5pp::walk(const SWCallback& ongroup, const SWCallback& onleave, const SWCallback& ondataset, const SWCallback& onlink, int maxlevel, const char *root) {
+	perf_scope pscope(perf);
+	budget_scope bscope(budget);
+	walk_callbacks callbacks = { &ongroup, &onleave, &ondataset, &onlink };
+	SWDict unused;
+	readgroup5_recursive(file, root, unused, maxlevel, &callbacks, root);
+}
+
+void H5pp::profile(bool enable) {
+	perf.enabled = enable;
+}
+
+SWDict H5pp::perfstats(const string& action) {
+	double hitrate = 0.0;
+	if (file >= 0) H5Fget_mdc_hit_rate(file, &hitrate);
+	SWDict result = perfstats_internal(perf, action);
+	result.insert("mdc_hit_rate", hitrate);
+	if (action == "reset" && file >= 0) H5Freset_mdc_hit_rate_stats(file);
+	return result;
+}
+
+extern "C" herr_t dumpgroup_callback (hid_t loc_id, const char *name, const H5L_info_t *info, void *operator_data);
+
+struct recursedata {
+	SWDict* groupdata;
+	int level;
+	// streaming dump: the members are passed to the callbacks instead of being stored
+	const walk_callbacks *walk;
+	string path;
+	string error;
+};
+
+void readgroup5_recursive(hid_t loc_id, const char *name, SWDict& groupdump, int maxlevel, const walk_callbacks *walk, const string& path) {
+	PERF_COUNT(objects, 1);
+	groupdump.insert("type", "GROUP");
+	groupdump.insert("name", name);
+	
+	// open the group
+	hid_t group_id=H5Gopen(loc_id, name, H5P_DEFAULT);
+
+	SWDict attrs;
+	readattr5_internal(group_id, attrs);
+	groupdump.insert("attrs", attrs);
+
+	if (walk) {
+		// the group without its members, break skips them
+		bool proceed;
+		try {
+			proceed = walk->ongroup->call(SWObject(MakeBaseSWObj(path)), groupdump);
+		} catch (...) {
+			H5Gclose(group_id);
+			throw;
+		}
+		if (!proceed) {
+			H5Gclose(group_id);
+			return;
+		}
+	}
+
+	SWDict data;
+	int level = maxlevel - 1;
+	herr_t status = 0;
+
+	if (level != 0) {
+	
+		recursedata rdata { &data, level, walk, path, string() };
+		status = H5Literate (group_id, H5_INDEX_NAME, 
+			H5_ITER_NATIVE, NULL, dumpgroup_callback, (void *) &rdata);
+		if (status < 0 && !rdata.error.empty()) {
+			H5Gclose(group_id);
+			STHROW(rdata.error);
+		}
+	}
+	
+	// close it
+	H5Gclose(group_id);
+	if (walk) {
+		if (status < 0) STHROW("Error reading group "<<path);
+		walk->onleave->call(SWObject(MakeBaseSWObj(path)), SWObject(MakeBaseSWObj(name)));
+	} else {
+		groupdump.insert("data", data);
+	}
+}
+
+// member of a group in the streaming dump. Errors, also from the callbacks,
+// are passed on as the return value, not as exceptions through HDF5
+static herr_t walkgroup_member(hid_t loc_id, const char *name, const H5L_info_t *info, recursedata& rdata) {
+	const walk_callbacks& walk = *rdata.walk;
+	string path = rdata.path == "/" ? "/" + string(name) : rdata.path + "/" + name;
+	try {
+		if (info->type == H5L_TYPE_SOFT) {
+			if (walk.onlink->empty()) return 0;
+			SWDict sldata;
+			readlink5_internal(loc_id, name, info, sldata);
+			walk.onlink->call(SWObject(MakeBaseSWObj(path)), sldata);
+			return 0;
+		}
+
+		H5O_info_t infobuf;
+		if (H5Oget_info_by_name (loc_id, name, &infobuf, H5O_INFO_BASIC, H5P_DEFAULT) < 0) return -1;
+
+		SWDict objdata;
+		switch (infobuf.type) {
+			case H5O_TYPE_GROUP:
+				readgroup5_recursive(loc_id, name, objdata, rdata.level, &walk, path);
+				return 0;
+			case H5O_TYPE_DATASET:
+				// nothing is read if nobody is interested
+				if (walk.ondataset->empty()) return 0;
+				readdataset5_internal(loc_id, name, objdata);
+				break;
+			case H5O_TYPE_NAMED_DATATYPE:
+				if (walk.ondataset->empty()) return 0;
+				readdatatype5_internal(loc_id, name, objdata);
+				break;
+			default:
+				if (walk.ondataset->empty()) return 0;
+				objdata.insert("type", "UNKNOWN");
+				objdata.insert("name", name);
+		}
+		walk.ondataset->call(SWObject(MakeBaseSWObj(path)), objdata);
+	} catch (const exception& e) {
+		rdata.error = e.what();
+		return -1;
+	}
+	return 0;
+}
+
+herr_t dumpgroup_callback (hid_t loc_id, const char *name, const H5L_info_t *info, void *operator_data) {
+	recursedata& rdata = *((recursedata *) operator_data);
+	if (rdata.walk) return walkgroup_member(loc_id, name, info, rdata);
+
+	if (info->type == H5L_TYPE_SOFT) {
+		// soft link. 
+		SWDict sldata;
+		readlink5_internal(loc_id, name, info, sldata);
+		// Insert soft link data into list
+		rdata.groupdata -> insert(name, sldata);
+		return 0; // Success
+	}
+
+	// other types: get object info
+	H5O_info_t      infobuf;
+	herr_t status = H5Oget_info_by_name (loc_id, name, &infobuf, H5O_INFO_ALL, H5P_DEFAULT);
+    
+	if (status<0) {
+		// pass error on
+		return status;
+	}
+
+    switch (infobuf.type) {
+        case H5O_TYPE_GROUP: {
+			/* Loop detector - disabled for now ***
+            if ( group_check (od, infobuf.addr) ) {
+                printf ("%*s  Warning: Loop detected!\n", spaces, "");
+            } **/
+
+			SWDict subgroupdata;
+			readgroup5_recursive(loc_id, name, subgroupdata, rdata.level);
+			rdata.groupdata -> insert(name, subgroupdata);
+            break;
+		}
+        case H5O_TYPE_DATASET: {
+            SWDict datasetdata;
+			readdataset5_internal(loc_id, name, datasetdata);
+			rdata.groupdata -> insert(name, datasetdata);
+            break;
+		}
+        case H5O_TYPE_NAMED_DATATYPE: {
+            SWDict datatypedata;
+			readdatatype5_internal(loc_id, name, datatypedata);
+			rdata.groupdata -> insert(name, datatypedata);
+            break;
+		}
+        default: {
+            // Unknown. Append mock object
+			SWDict unknown;
+			unknown.insert("type", "UNKNOWN");
+			unknown.insert("name", name);
+			rdata.groupdata -> insert(name, unknown);
+		}
+    }
+
+    return 0; //Success
+}
+
+void readlink5_internal(hid_t loc_id, const char *name, const H5L_info_t* info, SWDict& linkdata) { 
+	PERF_COUNT(objects, 1);
+	vector<char> targbuf(info->u.val_size+1);
+
+	if (H5Lget_val(loc_id, name, &targbuf[0], info->u.val_size, H5P_DEFAULT)<0) {
+		return; //Error
+	}
+	
+	SWDict attrs;
+	//readattr5_internal(loc_id, attrs);
+
+	linkdata.insert("type", "SOFTLINK");
+	linkdata.insert("name", name);
+	linkdata.insert("attrs", attrs);
+
+	linkdata.insert("data", &targbuf[0]);
+
+}
+
+// which interface to use to read the data
+enum h5_api {
+	h5a_api,
+	h5d_api
+};
+
+
+// replicate HDF5 native datatypes for 
+// the use in switch statements
+enum my_dtype {
+	MY_UNKNOWN,
+	MY_NATIVE_CHAR,
+	MY_NATIVE_SHORT,
+	MY_NATIVE_INT,
+	MY_NATIVE_LONG,
+	MY_NATIVE_LLONG,
+	MY_NATIVE_UCHAR,
+	MY_NATIVE_USHORT,
+	MY_NATIVE_UINT,
+	MY_NATIVE_ULONG,
+	MY_NATIVE_ULLONG,
+	MY_NATIVE_FLOAT,
+	MY_NATIVE_DOUBLE,
+	MY_NATIVE_LDOUBLE,
+	MY_NATIVE_C_S1,
+	MY_NATIVE_VLSTR
+};
+
+my_dtype h5t_to_my(hid_t dtype) {
+	// tedious task to ask for type identity
+	if (H5Tequal(dtype, H5T_NATIVE_CHAR)) return MY_NATIVE_CHAR;
+	if (H5Tequal(dtype, H5T_NATIVE_SHORT)) return MY_NATIVE_SHORT;
+	if (H5Tequal(dtype, H5T_NATIVE_INT)) return MY_NATIVE_INT;
+	if (H5Tequal(dtype, H5T_NATIVE_LONG)) return MY_NATIVE_LONG;
+	if (H5Tequal(dtype, H5T_NATIVE_LLONG)) return MY_NATIVE_LLONG;
+	if (H5Tequal(dtype, H5T_NATIVE_UCHAR)) return MY_NATIVE_UCHAR;
 	if (H5Tequal(dtype, H5T_NATIVE_USHORT)) return MY_NATIVE_USHORT;
 	if (H5Tequal(dtype, H5T_NATIVE_UINT)) return MY_NATIVE_UINT;
 	if (H5Tequal(dtype, H5T_NATIVE_ULONG)) return MY_NATIVE_ULONG;
@@ -523,250 +2482,3045 @@ my_dtype h5t_to_my(hid_t dtype) {
 	if (H5Tequal(dtype, H5T_NATIVE_FLOAT)) return MY_NATIVE_FLOAT;
 	if (H5Tequal(dtype, H5T_NATIVE_DOUBLE)) return MY_NATIVE_DOUBLE;
 	if (H5Tequal(dtype, H5T_NATIVE_LDOUBLE)) return MY_NATIVE_LDOUBLE;
-	if (H5Tget_class(dtype) == H5T_STRING) return MY_NATIVE_C_S1;
+	if (H5Tget_class(dtype) == H5T_STRING) {
+		return (H5Tis_variable_str(dtype) > 0) ? MY_NATIVE_VLSTR : MY_NATIVE_C_S1;
+	}
 	return MY_UNKNOWN;
 }
 
-struct my_dspaceinfo {
-	int rank;
-	vector<hsize_t> extents;
-	hsize_t nelements;
-};
+struct my_dspaceinfo {
+	int rank;
+	vector<hsize_t> extents;
+	hsize_t nelements;
+};
+
+static void eval_h5_dspace(hid_t dspace, my_dspaceinfo& dinfo) {
+	dinfo.rank = H5Sget_simple_extent_ndims(dspace);
+	vector<hsize_t> extents(dinfo.rank);
+	H5Sget_simple_extent_dims(dspace, &extents[0], NULL);
+	dinfo.extents.swap(extents); 
+
+	// a scalar data space holds one element, a null data space none
+	hssize_t npoints = H5Sget_simple_extent_npoints(dspace);
+	dinfo.nelements = (npoints > 0) ? npoints : 0;
+}
+
+struct my_typeinfo {
+	bool isatomic;
+	size_t nmembers;
+	size_t elsize;
+	hid_t native_dtype;
+};
+
+template <h5_api API>
+SWList eval_h5_dtype(my_typeinfo& typeinfo) {
+	SWList description;
+	typeinfo.isatomic=false;
+	typeinfo.nmembers=0;
+	typeinfo.elsize = H5Tget_size(typeinfo.native_dtype);
+	switch (H5Tget_class(typeinfo.native_dtype)) {
+		case H5T_INTEGER : { 
+			if (API==h5d_api) description.push_back("integer");
+			typeinfo.isatomic=true;
+			typeinfo.nmembers = 1;
+			break;
+		}
+		case H5T_FLOAT: {
+			if (API==h5d_api) description.push_back("float");
+			typeinfo.isatomic=true;
+			typeinfo.nmembers = 1;
+			break;
+		}
+		case H5T_STRING: {
+			if (API==h5d_api) description.push_back("string");
+			typeinfo.isatomic=true;
+			typeinfo.nmembers = 1;
+			if (H5Tis_variable_str(typeinfo.native_dtype) <= 0) {
+				// for pure strings, the size returned does not include the null terminator.
+				// Let HDF5 terminate every string, so that the elements stay evenly spaced
+				typeinfo.elsize++;
+				H5Tset_size(typeinfo.native_dtype, typeinfo.elsize);
+				H5Tset_strpad(typeinfo.native_dtype, H5T_STR_NULLTERM);
+			}
+			break;
+		}
+		case H5T_COMPOUND: {
+			typeinfo.isatomic=false;
+			typeinfo.nmembers = H5Tget_nmembers(typeinfo.native_dtype);
+			if (API==h5d_api) {
+				// create list of identifiers
+				for (size_t idx=0; idx<typeinfo.nmembers; idx++) {
+					char * name = H5Tget_member_name(typeinfo.native_dtype, idx);
+					description.push_back(name);
+					free(name);
+				}
+			}
+			break;
+		}
+		default: {
+		}
+	}
+
+	
+	return description;
+}
+
+// one value from a native buffer, big conversion switch - puh.
+// size is the space of fixed length strings, which need not be terminated
+static SWObject convert_element(const char *dbuf, my_dtype type, size_t size) {
+	SWObject result;
+#define DATACONV(MY_TYPE, CTYPE, SWTYPE) \
+		case MY_TYPE: {\
+			result.MakeBasic(static_cast<SWTYPE>(*(reinterpret_cast<const CTYPE*>(dbuf))));\
+			break;\
+		}
+
+	switch (type) {
+		// decide about datatype
+		DATACONV(MY_NATIVE_CHAR, char, int)
+		DATACONV(MY_NATIVE_SHORT,short, int)
+		DATACONV(MY_NATIVE_INT, int, int)
+		DATACONV(MY_NATIVE_LONG,long, long)
+		DATACONV(MY_NATIVE_LLONG,long long, long long)
+		DATACONV(MY_NATIVE_UCHAR,unsigned char, int)
+		DATACONV(MY_NATIVE_USHORT,unsigned short, int)
+		DATACONV(MY_NATIVE_UINT, unsigned int, long)
+		DATACONV(MY_NATIVE_ULONG,unsigned long, long long)
+		DATACONV(MY_NATIVE_ULLONG,unsigned long long, unsigned long long)
+		DATACONV(MY_NATIVE_FLOAT,float, float)
+		DATACONV(MY_NATIVE_DOUBLE,double, double)
+		DATACONV(MY_NATIVE_LDOUBLE,long double, double)
+		case MY_NATIVE_C_S1: {
+			const char *end = static_cast<const char*>(memchr(dbuf, '\0', size));
+			result.MakeBasic(SWStringRef(dbuf, end ? end - dbuf : size));
+			break;
+		} 
+		case MY_NATIVE_VLSTR: {
+			// pointer to the string, moved to the string storage by importdata
+			const char *str = *reinterpret_cast<const char * const *>(dbuf);
+			result.MakeBasic(str ? str : "");
+			break;
+		}
+
+		default: {
+			result.MakeBasic(string("???"));
+		}
+	}
+#undef DATACONV
+	return result;
+}
+
+// data set read in its native memory layout, elements are converted on access
+class h5_element_source : public SWLazySource {
+	vector<char> buffer;
+	// variable length strings, buffer points into it
+	vector<char> strings;
+	size_t elsize;
+	size_t nelements;
+	vector<ssize_t> eloffsets;
+	vector<my_dtype> eltypes;
+	vector<size_t> elsizes;
+
+public:
+	h5_element_source(vector<char>& buf, vector<char>& strs, size_t elsize, size_t nelements, const vector<ssize_t>& eloffsets, const vector<my_dtype>& eltypes, const vector<size_t>& elsizes) :
+		elsize(elsize), nelements(nelements), eloffsets(eloffsets), eltypes(eltypes), elsizes(elsizes) {
+		// swapping keeps the storage, the pointers stay valid
+		buffer.swap(buf);
+		strings.swap(strs);
+	}
+
+	size_t size() const {
+		return nelements * eltypes.size();
+	}
+
+	SWObject element(size_t index) const {
+		size_t el = index / eltypes.size(), member = index % eltypes.size();
+		return convert_element(&buffer[el*elsize + eloffsets[member]], eltypes[member], elsizes[member]);
+	}
+};
+
+// offsets, data types and sizes of the members of one element.
+// Returns true if there are variable length strings
+static bool eval_h5_members(const my_typeinfo& typeinfo, vector<ssize_t>& eloffsets, vector<my_dtype>& eltypes, vector<size_t>& elsizes) {
+	eloffsets.assign(typeinfo.nmembers, 0);
+	eltypes.assign(typeinfo.nmembers, MY_UNKNOWN);
+	elsizes.assign(typeinfo.nmembers, 0);
+	bool hasvlstr = false;
+	if (typeinfo.isatomic) {
+		// only one element
+		eloffsets[0]=0;
+		eltypes[0]=h5t_to_my(typeinfo.native_dtype);
+		elsizes[0]=typeinfo.elsize;
+		hasvlstr = eltypes[0]==MY_NATIVE_VLSTR;
+	} else {
+		// multiple elements
+		for (size_t ind=0; ind<typeinfo.nmembers; ind++) {
+			eloffsets[ind]=H5Tget_member_offset(typeinfo.native_dtype, ind);
+			hid_t mtype = H5Tget_member_type(typeinfo.native_dtype, ind);
+			eltypes[ind] = h5t_to_my(mtype);
+			elsizes[ind] = H5Tget_size(mtype);
+			hasvlstr = hasvlstr || eltypes[ind]==MY_NATIVE_VLSTR;
+			H5Tclose(mtype);
+		}
+	}
+	return hasvlstr;
+}
+
+template <h5_api API>
+static SWObject importdata(hid_t resource_id, my_typeinfo typeinfo, my_dspaceinfo dinfo) {
+	size_t memsize = typeinfo.elsize*dinfo.nelements;
+	vector<char> bufferspace(memsize);
+	char * buf = &bufferspace[0];
+	PERF_COUNT(allocations, 1);
+	PERF_COUNT(bytes, memsize);
+	{
+		perf_timer timer(&perf_counters::t_io);
+		if (API==h5d_api) {
+			H5Dread(resource_id, typeinfo.native_dtype, H5S_ALL, H5S_ALL, H5P_DEFAULT, buf);
+		} else {
+			// h5a_api
+			H5Aread(resource_id, typeinfo.native_dtype, buf);
+		}
+	}
+
+	perf_timer decodetimer(&perf_counters::t_decode);
+	// compute offsets and data types as constants
+	vector<ssize_t> eloffsets;
+	vector<my_dtype> eltypes;
+	vector<size_t> elsizes;
+	bool hasvlstr = eval_h5_members(typeinfo, eloffsets, eltypes, elsizes);
+
+	vector<char> strings;
+	if (hasvlstr) {
+		PERF_COUNT(allocations, 1);
+		// copy the variable length strings into one block, 
+		// then release the memory allocated by HDF5 in one go
+		vector<size_t> stroffsets;
+		for (char * el = buf; el < buf+memsize; el +=typeinfo.elsize) {
+			for (size_t ind=0; ind<typeinfo.nmembers; ind++) {
+				if (eltypes[ind]!=MY_NATIVE_VLSTR) continue;
+				const char *str = *reinterpret_cast<char **>(el + eloffsets[ind]);
+				if (!str) str = "";
+				stroffsets.push_back(strings.size());
+				strings.insert(strings.end(), str, str + strlen(str) + 1);
+			}
+		}
+
+		hid_t space = (API==h5d_api) ? H5Dget_space(resource_id) : H5Aget_space(resource_id);
+		H5Dvlen_reclaim(typeinfo.native_dtype, space, H5P_DEFAULT, buf);
+		H5Sclose(space);
+
+		size_t nstr = 0;
+		for (char * el = buf; el < buf+memsize; el +=typeinfo.elsize) {
+			for (size_t ind=0; ind<typeinfo.nmembers; ind++) {
+				if (eltypes[ind]!=MY_NATIVE_VLSTR) continue;
+				*reinterpret_cast<const char **>(el + eloffsets[ind]) = &strings[stroffsets[nstr++]];
+			}
+		}
+	}
+
+	decodetimer.stop();
+	perf_timer marshaltimer(&perf_counters::t_marshal);
+	if (API==h5d_api) {
+		// data set payloads are converted only when the elements are needed,
+		// if lazy lists are enabled
+		PERF_COUNT(created, SWLazyListEnabled() ? 1 : dinfo.nelements*typeinfo.nmembers + 1);
+		return MakeLazyList(new h5_element_source(bufferspace, strings, typeinfo.elsize, dinfo.nelements, eloffsets, eltypes, elsizes));
+	}
+
+	PERF_COUNT(created, dinfo.nelements*typeinfo.nmembers + (dinfo.nelements!=1));
+	SWList data;
+	SWObject sobject;
+	for (char * el = buf; el < buf+memsize; el +=typeinfo.elsize) {
+		//iterate over all elements in this attribute
+		for (size_t ind=0; ind<typeinfo.nmembers; ind++) {
+			sobject = convert_element(el + eloffsets[ind], eltypes[ind], elsizes[ind]);
+			if (dinfo.nelements!=1) data.push_back(sobject);
+		}
+	}
+
+	if (dinfo.nelements==1) return sobject;
+	else return data;
+}
+
+// estimated memory after reading a data set into a list, as sds_memory,
+// with one object per member of a compound
+static size_t h5_memory(hid_t native, size_t nelements) {
+	size_t members = 1;
+	if (H5Tget_class(native) == H5T_COMPOUND) members = H5Tget_nmembers(native);
+	return H5Tget_size(native)*nelements + nelements*members*element_overhead + object_overhead;
+}
+
+static column_reader *open_h5_column(hid_t loc_id, const char *path);
+
+void readdataset5_internal(hid_t loc_id, const char *name, SWDict& datasetdata) {
+	PERF_COUNT(objects, 1);
+	datasetdata.insert("type", "DATASET");
+	datasetdata.insert("name", name);
+	
+	// open data set
+	hid_t dset = H5Dopen(loc_id, name, H5P_DEFAULT);
+	// get data space & type
+	hid_t dspace = H5Dget_space(dset);
+	hid_t dtype  = H5Dget_type(dset);
+
+	SWDict attrs;
+	readattr5_internal(dset, attrs);
+	datasetdata.insert("attrs", attrs);
+
+	my_dspaceinfo dinfo;
+	eval_h5_dspace(dspace, dinfo);
+
+	SWList dspace_list;
+	dspace_list.push_back(dinfo.extents);
+	datasetdata.insert("dspace", dspace_list);
+	datasetdata.insert("ndata", dinfo.nelements);
+
+
+	my_typeinfo tinfo;
+	tinfo.native_dtype = H5Tget_native_type(dtype, H5T_DIR_ASCEND);
+	SWList dtype_list = eval_h5_dtype<h5d_api>(tinfo);
+	datasetdata.insert("dtype", dtype_list);
+
+	size_t memory = h5_memory(tinfo.native_dtype, dinfo.nelements);
+	if (budget_active && !budget_active->take(memory)) {
+		// over the budget: placeholder and a preview of 1D data
+		unique_ptr<column_reader> reader(dinfo.rank == 1 ? open_h5_column(loc_id, name) : NULL);
+		datasetdata.insert("data", SWList());
+		datasetdata.insert("skipped", skipped_data(memory, reader.get()));
+	} else {
+		datasetdata.insert("data", importdata<h5d_api>(dset, tinfo, dinfo));
+	}
+
+	// close type&space
+	H5Tclose(tinfo.native_dtype);
+	H5Tclose(dtype);
+	H5Sclose(dspace);
+	// close data set
+	H5Dclose(dset);
+}
+
+// totals of a tree, walked like dump but without reading data
+struct size_estimate {
+	size_t objects;
+	size_t datasets;
+	size_t attributes;
+	size_t bytes;
+	size_t memory;
+	string largest;
+	size_t largest_memory;
+	int level;
+	string path;
+};
+
+extern "C" herr_t estimategroup_callback (hid_t loc_id, const char *name, const H5L_info_t *info, void *operator_data);
+
+static void estimate_group5(hid_t loc_id, const char *name, size_estimate& est) {
+	hid_t group_id = H5Gopen(loc_id, name, H5P_DEFAULT);
+	if (group_id < 0) STHROW("Can't open group "<<name);
+	H5O_info_t infobuf;
+	if (H5Oget_info(group_id, &infobuf, H5O_INFO_NUM_ATTRS) >= 0) {
+		est.attributes += infobuf.num_attrs;
+	}
+	est.objects++;
+	
+	int level = est.level;
+	est.level--;
+	if (est.level != 0) {
+		H5Literate(group_id, H5_INDEX_NAME, H5_ITER_NATIVE, NULL, estimategroup_callback, &est);
+	}
+	est.level = level;
+	H5Gclose(group_id);
+}
+
+static void estimate_dataset5(hid_t loc_id, const char *name, size_estimate& est) {
+	hid_t dset = H5Dopen(loc_id, name, H5P_DEFAULT);
+	if (dset < 0) return;
+	hid_t dspace = H5Dget_space(dset);
+	hid_t dtype = H5Dget_type(dset);
+	hid_t native = H5Tget_native_type(dtype, H5T_DIR_ASCEND);
+	H5O_info_t infobuf;
+	if (H5Oget_info(dset, &infobuf, H5O_INFO_NUM_ATTRS) >= 0) {
+		est.attributes += infobuf.num_attrs;
+	}
+
+	my_dspaceinfo dinfo;
+	eval_h5_dspace(dspace, dinfo);
+	// variable length strings are counted with the size of the pointer
+	size_t bytes = H5Tget_size(native) * dinfo.nelements;
+	size_t memory = h5_memory(native, dinfo.nelements);
+	est.objects++;
+	est.datasets++;
+	est.bytes += bytes;
+	est.memory += memory;
+	if (memory > est.largest_memory) {
+		est.largest_memory = memory;
+		est.largest = est.path + name;
+	}
+
+	H5Tclose(native);
+	H5Tclose(dtype);
+	H5Sclose(dspace);
+	H5Dclose(dset);
+}
+
+herr_t estimategroup_callback (hid_t loc_id, const char *name, const H5L_info_t *info, void *operator_data) {
+	size_estimate& est = *reinterpret_cast<size_estimate*>(operator_data);
+	if (info->type == H5L_TYPE_SOFT) {
+		est.objects++;
+		return 0;
+	}
+
+	H5O_info_t infobuf;
+	if (H5Oget_info_by_name(loc_id, name, &infobuf, H5O_INFO_BASIC, H5P_DEFAULT) < 0) return 0;
+
+	switch (infobuf.type) {
+		case H5O_TYPE_GROUP: {
+			string saved = est.path;
+			est.path += name;
+			est.path += "/";
+			estimate_group5(loc_id, name, est);
+			est.path = saved;
+			break;
+		}
+		case H5O_TYPE_DATASET:
+			estimate_dataset5(loc_id, name, est);
+			break;
+		default:
+			est.objects++;
+	}
+	return 0;
+}
+
+SWDict H5pp::estimate(int maxlevel, const char *root) {
+	size_estimate est;
+	est.objects = est.datasets = est.attributes = est.bytes = est.memory = est.largest_memory = 0;
+	est.level = maxlevel;
+	est.path = root;
+	if (est.path.empty() || est.path[est.path.size()-1] != '/') est.path += "/";
+	estimate_group5(file, root, est);
+	est.memory += (est.objects + est.attributes) * object_overhead;
+
+	SWDict result;
+	result.insert("objects", est.objects);
+	result.insert("datasets", est.datasets);
+	result.insert("attributes", est.attributes);
+	result.insert("bytes", est.bytes);
+	result.insert("memory", est.memory);
+	result.insert("largest", est.largest);
+	result.insert("largest_memory", est.largest_memory);
+	return result;
+}
+
+void H5pp::memory_budget(size_t maxbytes) {
+	budget = maxbytes;
+}
+
+static bool h5_has_member(hid_t dtype, const char *member) {
+	if (H5Tget_class(dtype) != H5T_COMPOUND) return false;
+	return H5Tget_member_index(dtype, member) >= 0;
+}
+
+// the value member of a compound data set, 
+// i.e. the first one which is not the PosCounter
+static string h5_value_member(hid_t dtype) {
+	int nmembers = H5Tget_nmembers(dtype);
+	string result;
+	for (int idx = 0; idx < nmembers; idx++) {
+		char * name = H5Tget_member_name(dtype, idx);
+		string mname(name);
+		free(name);
+		if (mname != "PosCounter" || nmembers == 1) {
+			result = mname;
+			break;
+		}
+	}
+	return result;
+}
+
+// select the elements [start, end) of the flattened data space, as a 
+// union of at most 2*rank-1 boxes. offset holds the indices of the outer dimensions
+static void select_flat_range(hid_t fspace, const my_dspaceinfo& dinfo, int dim, vector<hsize_t>& offset, hsize_t start, hsize_t end, bool& first) {
+	hsize_t inner = 1;
+	for (int d = dim+1; d < dinfo.rank; d++) inner *= dinfo.extents[d];
+	
+	hsize_t i0 = start / inner;
+	hsize_t i1 = end / inner;
+	if (start % inner != 0 && i0 == (end - 1) / inner) {
+		// within one index of this dimension
+		offset[dim] = i0;
+		select_flat_range(fspace, dinfo, dim+1, offset, start - i0*inner, end - i0*inner, first);
+		return;
+	}
+	
+	if (start % inner != 0) {
+		// leading partial block
+		offset[dim] = i0;
+		select_flat_range(fspace, dinfo, dim+1, offset, start - i0*inner, inner, first);
+		i0++;
+	}
+
+	if (i1 > i0) {
+		// full blocks along this dimension
+		vector<hsize_t> boxoffset(offset);
+		vector<hsize_t> boxcount(dinfo.extents);
+		for (int d = 0; d < dim; d++) boxcount[d] = 1;
+		boxoffset[dim] = i0;
+		boxcount[dim] = i1 - i0;
+		for (int d = dim+1; d < dinfo.rank; d++) boxoffset[d] = 0;
+		H5Sselect_hyperslab(fspace, first ? H5S_SELECT_SET : H5S_SELECT_OR, &boxoffset[0], NULL, &boxcount[0], NULL);
+		first = false;
+	}
+
+	if (end % inner != 0) {
+		// trailing partial block
+		offset[dim] = i1;
+		select_flat_range(fspace, dinfo, dim+1, offset, 0, end - i1*inner, first);
+	}
+}
+
+// location of the raw data of a data set in the file. Only known for
+// contiguous, unfiltered storage in the native type of this machine in a file
+// opened with the default (sec2) driver; otherwise, and on Windows, valid()
+// is false and the data must be read with H5Dread
+struct h5_raw_location {
+	int fd;
+	off_t offset;
+	size_t bytes;
+
+	h5_raw_location(hid_t dset, hid_t dtype, hid_t native) : fd(-1), offset(0), bytes(0) {
+#ifndef _WIN32
+		hid_t dcpl = H5Dget_create_plist(dset);
+		bool contiguous = H5Pget_layout(dcpl) == H5D_CONTIGUOUS && H5Pget_nfilters(dcpl) == 0;
+		H5Pclose(dcpl);
+		if (!contiguous) return;
+		if (H5Tequal(dtype, native) <= 0 || H5Tdetect_class(dtype, H5T_VLEN) > 0) return;
+		if (H5Tget_class(dtype) == H5T_STRING && H5Tis_variable_str(dtype) > 0) return;
+
+		// the offset includes the user block, 
+		// undefined if the storage is not allocated yet
+		haddr_t addr = H5Dget_offset(dset);
+		if (addr == HADDR_UNDEF) return;
+		hid_t space = H5Dget_space(dset);
+		hssize_t npoints = H5Sget_simple_extent_npoints(space);
+		H5Sclose(space);
+		size_t nbytes = npoints * H5Tget_size(native);
+		if (npoints <= 0 || H5Dget_storage_size(dset) != nbytes) return;
+
+		hid_t fid = H5Iget_file_id(dset);
+		hid_t fapl = H5Fget_access_plist(fid);
+		int *handle = NULL;
+		if (H5Pget_driver(fapl) == H5FD_SEC2) {
+			H5Fget_vfd_handle(fid, fapl, reinterpret_cast<void**>(&handle));
+		}
+		H5Pclose(fapl);
+		H5Fclose(fid);
+		if (!handle) return;
+		fd = *handle;
+		offset = addr;
+		bytes = nbytes;
+#else
+		(void)dset; (void)dtype; (void)native;
+#endif
+	}
+
+	bool valid() const { return fd >= 0; }
+};
+
+// read-only memory map of bytes first to first+bytes of the raw data of a
+// data set, kept for one call only. Ranges past the current end of the file
+// are not mapped, valid() is then false. This narrows, but does not close,
+// the window for SIGBUS: a truncation by another process after the check
+// still makes the access to the missing pages fail
+class h5_mapping {
+	void *base;
+	size_t maplen;
+	const char *data;
+	size_t len;
+
+	h5_mapping(const h5_mapping&);
+	h5_mapping& operator = (const h5_mapping&);
+
+public:
+	// no mapping for NULL or an invalid location
+	h5_mapping(const h5_raw_location *loc, size_t first, size_t bytes) : base(NULL), maplen(0), data(NULL), len(0) {
+#ifndef _WIN32
+		if (!loc || !loc->valid() || bytes == 0 || first + bytes > loc->bytes) return;
+		off_t start = loc->offset + first;
+		struct stat st;
+		if (fstat(loc->fd, &st) != 0 || st.st_size < start || size_t(st.st_size - start) < bytes) return;
+
+		// mmap needs a page aligned offset
+		off_t pagesize = sysconf(_SC_PAGESIZE);
+		off_t aligned = start - start % pagesize;
+		size_t skip = start - aligned;
+		void *p = mmap(NULL, bytes + skip, PROT_READ, MAP_SHARED, loc->fd, aligned);
+		if (p == MAP_FAILED) return;
+		base = p;
+		maplen = bytes + skip;
+		data = static_cast<const char*>(p) + skip;
+		len = bytes;
+#else
+		(void)loc; (void)first; (void)bytes;
+#endif
+	}
+
+	~h5_mapping() {
+#ifndef _WIN32
+		if (base) munmap(base, maplen);
+#endif
+	}
+
+	bool valid() const { return data != NULL; }
+	const char *ptr() const { return data; }
+	size_t size() const { return len; }
+};
+
+// values with the given stride in native layout to double
+template <typename T>
+static void convert_strided(const char *src, size_t stride, size_t n, double *out) {
+	for (size_t i = 0; i < n; i++) {
+		T v;
+		memcpy(&v, src + i*stride, sizeof(T));
+		out[i] = static_cast<double>(v);
+	}
+}
+
+static bool is_numeric(my_dtype type) {
+	return type >= MY_NATIVE_CHAR && type <= MY_NATIVE_LDOUBLE;
+}
+
+static void convert_strided(my_dtype type, const char *src, size_t stride, size_t n, double *out) {
+	switch (type) {
+		case MY_NATIVE_CHAR: convert_strided<signed char>(src, stride, n, out); break;
+		case MY_NATIVE_SHORT: convert_strided<short>(src, stride, n, out); break;
+		case MY_NATIVE_INT: convert_strided<int>(src, stride, n, out); break;
+		case MY_NATIVE_LONG: convert_strided<long>(src, stride, n, out); break;
+		case MY_NATIVE_LLONG: convert_strided<long long>(src, stride, n, out); break;
+		case MY_NATIVE_UCHAR: convert_strided<unsigned char>(src, stride, n, out); break;
+		case MY_NATIVE_USHORT: convert_strided<unsigned short>(src, stride, n, out); break;
+		case MY_NATIVE_UINT: convert_strided<unsigned int>(src, stride, n, out); break;
+		case MY_NATIVE_ULONG: convert_strided<unsigned long>(src, stride, n, out); break;
+		case MY_NATIVE_ULLONG: convert_strided<unsigned long long>(src, stride, n, out); break;
+		case MY_NATIVE_FLOAT: convert_strided<float>(src, stride, n, out); break;
+		case MY_NATIVE_DOUBLE: 
+			if (stride == sizeof(double)) {
+				memcpy(out, src, n*sizeof(double));
+			} else {
+				convert_strided<double>(src, stride, n, out); 
+			}
+			break;
+		case MY_NATIVE_LDOUBLE: convert_strided<long double>(src, stride, n, out); break;
+		default: STHROW("Unsupported data type for conversion");
+	}
+}
+
+// streaming access to a numeric data set or one member of a compound data set.
+// Multidimensional data sets are read as a flat array in C order
+class h5_column_reader : public column_reader {
+	hid_t dset;
+	hid_t fspace;
+	hid_t memtype;
+	my_dspaceinfo dinfo;
+	// raw data, of which each read maps only the range it needs if the
+	// layout allows it. Nothing stays mapped between the calls, as a cursor
+	// may hold the reader for a long time
+	unique_ptr<h5_raw_location> rawdata;
+	my_dtype maptype;
+	size_t mapoffset, mapstride;
+	
+	void cleanup() {
+		if (memtype >= 0) H5Tclose(memtype);
+		if (fspace >= 0) H5Sclose(fspace);
+		if (dset >= 0) H5Dclose(dset);
+	}
+
+	// map the data set, values are then converted directly from the file
+	void map_raw(const string& mname) {
+		hid_t dtype = H5Dget_type(dset);
+		hid_t native = H5Tget_native_type(dtype, H5T_DIR_ASCEND);
+		rawdata.reset(new h5_raw_location(dset, dtype, native));
+		if (rawdata->valid()) {
+			mapstride = H5Tget_size(native);
+			if (mname.empty()) {
+				mapoffset = 0;
+				maptype = h5t_to_my(native);
+			} else {
+				int idx = H5Tget_member_index(native, mname.c_str());
+				hid_t mtype = H5Tget_member_type(native, idx);
+				mapoffset = H5Tget_member_offset(native, idx);
+				maptype = h5t_to_my(mtype);
+				H5Tclose(mtype);
+			}
+			if (!is_numeric(maptype)) rawdata.reset();
+		} else {
+			rawdata.reset();
+		}
+		H5Tclose(native);
+		H5Tclose(dtype);
+	}
+
+public:
+	h5_column_reader(hid_t loc_id, const char *path, const string& member) : dset(-1), fspace(-1), memtype(-1) {
+		dset = H5Dopen(loc_id, path, H5P_DEFAULT);
+		if (dset < 0) STHROW("Can't open data set "<<path);
+		
+		fspace = H5Dget_space(dset);
+		eval_h5_dspace(fspace, dinfo);
+
+		hid_t dtype = H5Dget_type(dset);
+		H5T_class_t tclass = H5Tget_class(dtype);
+		if (tclass == H5T_COMPOUND) {
+			// let HDF5 extract the member and convert it to double
+			string mname = member.empty() ? h5_value_member(dtype) : member;
+			int idx = H5Tget_member_index(dtype, mname.c_str());
+			H5T_class_t mclass = (idx >= 0) ? H5Tget_member_class(dtype, idx) : H5T_NO_CLASS;
+			H5Tclose(dtype);
+			if (idx < 0) {
+				cleanup();
+				STHROW("Data set "<<path<<" has no member "<<mname);
+			}
+			if (mclass != H5T_INTEGER && mclass != H5T_FLOAT) {
+				cleanup();
+				STHROW("Member "<<mname<<" of data set "<<path<<" is not numeric");
+			}
+			memtype = H5Tcreate(H5T_COMPOUND, sizeof(double));
+			H5Tinsert(memtype, mname.c_str(), 0, H5T_NATIVE_DOUBLE);
+			map_raw(mname);
+		} else {
+			H5Tclose(dtype);
+			if (tclass != H5T_INTEGER && tclass != H5T_FLOAT) {
+				cleanup();
+				STHROW("Data set "<<path<<" is not numeric");
+			}
+			if (!member.empty()) {
+				cleanup();
+				STHROW("Data set "<<path<<" is not a compound data set, can't select member "<<member);
+			}
+			memtype = H5Tcopy(H5T_NATIVE_DOUBLE);
+			map_raw("");
+		}
+	}
+
+	~h5_column_reader() {
+		cleanup();
+	}
+
+	const my_dspaceinfo& dspace() const {
+		return dinfo;
+	}
+
+	size_t size() const {
+		return dinfo.nelements;
+	}
+
+	void read(size_t start, size_t count, double *out) {
+		if (count == 0) return;
+		if (rawdata && start + count > dinfo.nelements) STHROW("Error reading values "<<start<<" to "<<start+count-1);
+		h5_mapping mapping(rawdata.get(), start*mapstride, count*mapstride);
+		if (mapping.valid()) {
+			convert_strided(maptype, mapping.ptr() + mapoffset, mapstride, count, out);
+			return;
+		}
+		if (dinfo.rank == 0) {
+			// scalar data set
+			if (H5Dread(dset, memtype, H5S_ALL, H5S_ALL, H5P_DEFAULT, out) < 0) {
+				STHROW("Error reading data set");
+			}
+			return;
+		}
+
+		// the range is selected exactly, so that only the requested values are read
+		vector<hsize_t> offset(dinfo.rank, 0);
+		bool first = true;
+		select_flat_range(fspace, dinfo, 0, offset, start, start + count, first);
+		
+		hsize_t nread = count;
+		hid_t mspace = H5Screate_simple(1, &nread, NULL);
+		herr_t status = H5Dread(dset, memtype, mspace, fspace, H5P_DEFAULT, out);
+		H5Sclose(mspace);
+		if (status < 0) STHROW("Error reading values "<<start<<" to "<<start+count-1);
+	}
+
+	// read a hyperslab with the given start and count in every dimension
+	void read_box(const vector<hsize_t>& start, const vector<hsize_t>& count, double *out) {
+		hsize_t nread = 1;
+		for (size_t d = 0; d < count.size(); d++) nread *= count[d];
+		if (nread == 0) return;
+		// the mapping spans the first to the last element of the box
+		size_t rank = count.size();
+		size_t first = 0, last = 0;
+		for (size_t d = 0; d < rank; d++) {
+			first = first*dinfo.extents[d] + start[d];
+			last = last*dinfo.extents[d] + start[d] + count[d] - 1;
+		}
+		h5_mapping mapping(rawdata.get(), first*mapstride, (last + 1 - first)*mapstride);
+		if (mapping.valid()) {
+			// one run along the last dimension per row of the box
+			size_t run = count[rank-1];
+			vector<hsize_t> idx(start);
+			for (size_t done = 0; done < nread; done += run) {
+				size_t flat = 0;
+				for (size_t d = 0; d < rank; d++) flat = flat*dinfo.extents[d] + idx[d];
+				convert_strided(maptype, mapping.ptr() + (flat - first)*mapstride + mapoffset, mapstride, run, out + done);
+				// advance the row index, last dimension excluded
+				for (size_t d = rank-1; d-- > 0; ) {
+					if (++idx[d] < start[d] + count[d]) break;
+					idx[d] = start[d];
+				}
+			}
+			return;
+		}
+		H5Sselect_hyperslab(fspace, H5S_SELECT_SET, &start[0], NULL, &count[0], NULL);
+		hid_t mspace = H5Screate_simple(1, &nread, NULL);
+		herr_t status = H5Dread(dset, memtype, mspace, fspace, H5P_DEFAULT, out);
+		H5Sclose(mspace);
+		if (status < 0) STHROW("Error reading hyperslab");
+	}
+};
+
+// reader for the value column of a data set, NULL if it is not numeric
+static column_reader *open_h5_column(hid_t loc_id, const char *path) {
+	try {
+		return new h5_column_reader(loc_id, path, "");
+	} catch (const runtime_error&) {
+		return NULL;
+	}
+}
+
+SWDict H5pp::decimate(const char *path, size_t nbuckets, const string& mode, long first, long last, const string& member) {
+	h5_column_reader yreader(file, path, member);
+	
+	// the BESSY scans store {PosCounter, value}, plot over the PosCounter
+	hid_t dset = H5Dopen(file, path, H5P_DEFAULT);
+	hid_t dtype = H5Dget_type(dset);
+	bool haspos = h5_has_member(dtype, "PosCounter") && member != "PosCounter";
+	H5Tclose(dtype);
+	H5Dclose(dset);
+
+	if (haspos) {
+		h5_column_reader xreader(file, path, "PosCounter");
+		return decimate_internal(yreader, &xreader, nbuckets, mode, first, last);
+	}
+	return decimate_internal(yreader, NULL, nbuckets, mode, first, last);
+}
+
+Cursor *H5pp::open_dataset(const char *path, const string& member) {
+	hbool_t threadsafe = false;
+	H5is_library_threadsafe(&threadsafe);
+	return new Cursor(new h5_column_reader(file, path, member), threadsafe);
+}
+
+SWDict H5pp::stats(const char *path, const string& member) {
+	h5_column_reader reader(file, path, member);
+	return stats_internal(reader);
+}
+
+// one channel of a scan, sorted by PosCounter with unique keys
+struct scan_column {
+	vector<long long> keys;
+	vector<double> values;
+};
+
+enum dup_policy { dup_first, dup_last, dup_mean };
+
+static void read_scan_column(hid_t file, const string& path, dup_policy policy, scan_column& col) {
+	h5_column_reader kreader(file, path.c_str(), "PosCounter");
+	h5_column_reader vreader(file, path.c_str(), "");
+	size_t n = kreader.size();
+	
+	vector<double> kbuf(n), vbuf(n);
+	kreader.read(0, n, kbuf.empty() ? NULL : &kbuf[0]);
+	vreader.read(0, n, vbuf.empty() ? NULL : &vbuf[0]);
+
+	// the scans are normally written in order, sort only if necessary
+	vector<size_t> order(n);
+	for (size_t i = 0; i < n; i++) order[i] = i;
+	bool sorted = true;
+	for (size_t i = 1; i < n && sorted; i++) sorted = kbuf[i-1] <= kbuf[i];
+	if (!sorted) {
+		stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return kbuf[a] < kbuf[b]; });
+	}
+
+	col.keys.clear();
+	col.values.clear();
+	size_t i = 0;
+	while (i < n) {
+		long long key = kbuf[order[i]];
+		size_t j = i;
+		double sum = 0.0;
+		size_t count = 0;
+		while (j < n && (long long)kbuf[order[j]] == key) {
+			double v = vbuf[order[j]];
+			if (v == v) { sum += v; count++; }
+			j++;
+		}
+		double value;
+		switch (policy) {
+			case dup_first: value = vbuf[order[i]]; break;
+			case dup_last: value = vbuf[order[j-1]]; break;
+			default: value = count ? sum / count : numeric_limits<double>::quiet_NaN();
+		}
+		col.keys.push_back(key);
+		col.values.push_back(value);
+		i = j;
+	}
+}
+
+static void join_scan_columns(const vector<scan_column>& cols, bool outer, vector<long long>& keys, vector< vector<double> >& table) {
+	// merge join over the sorted keys
+	size_t ncols = cols.size();
+	keys.clear();
+	table.assign(ncols, vector<double>());
+	vector<size_t> pos(ncols, 0);
+	const double nan = numeric_limits<double>::quiet_NaN();
+	
+	while (true) {
+		// smallest key not yet consumed, and whether all columns have it
+		bool found = false, inall = true;
+		long long key = 0;
+		for (size_t c = 0; c < ncols; c++) {
+			if (pos[c] >= cols[c].keys.size()) { inall = false; continue; }
+			long long k = cols[c].keys[pos[c]];
+			if (!found || k < key) {
+				if (found) inall = false;
+				key = k;
+				found = true;
+			} else if (k > key) {
+				inall = false;
+			}
+		}
+		if (!found) break;
+		if (!outer && !inall) {
+			// inner join: skip the smallest key 
+			for (size_t c = 0; c < ncols; c++) {
+				if (pos[c] < cols[c].keys.size() && cols[c].keys[pos[c]] == key) pos[c]++;
+			}
+			continue;
+		}
+
+		keys.push_back(key);
+		for (size_t c = 0; c < ncols; c++) {
+			if (pos[c] < cols[c].keys.size() && cols[c].keys[pos[c]] == key) {
+				table[c].push_back(cols[c].values[pos[c]]);
+				pos[c]++;
+			} else {
+				table[c].push_back(nan);
+			}
+		}
+	}
+}
+
+static dup_policy eval_dup_policy(const string& duplicates) {
+	if (duplicates == "first") return dup_first;
+	if (duplicates == "last") return dup_last;
+	if (duplicates == "mean") return dup_mean;
+	STHROW("Unknown duplicate policy "<<duplicates<<", must be first, last or mean");
+}
+
+SWDict H5pp::jointable(const char *group, const SWList& datasets, const string& duplicates, const string& join) {
+	dup_policy policy = eval_dup_policy(duplicates);
+	
+	bool outer;
+	if (join == "outer") outer = true;
+	else if (join == "inner") outer = false;
+	else STHROW("Unknown join "<<join<<", must be outer or inner");
+
+	size_t ncols = datasets.size();
+	vector<scan_column> cols(ncols);
+	vector<string> names(ncols);
+	for (size_t c = 0; c < ncols; c++) {
+		// names are relative to the group, unless absolute. 
+		// Soft links are resolved by HDF5
+		names[c] = datasets.getString(c);
+		string path = names[c];
+		if (path.empty() || path[0] != '/') path = string(group) + "/" + path;
+		read_scan_column(file, path, policy, cols[c]);
+	}
+
+	vector<long long> keys;
+	vector< vector<double> > table;
+	join_scan_columns(cols, outer, keys, table);
+
+	vector<long> shape(1, keys.size());
+	SWDict result;
+	result.insert("PosCounter", make_packed("int64", shape, keys));
+	for (size_t c = 0; c < ncols; c++) {
+		result.insert(names[c], make_packed("float64", shape, table[c]));
+	}
+	return result;
+}
+
+SWDict H5pp::compute(const string& expression, const SWList& operands, const string& align) {
+	// operands is a dict of name -> path or {path member}
+	if (operands.size() % 2 != 0) STHROW("Operands must be a dict of name and data set");
+	if (align != "index" && align != "poscounter") STHROW("Unknown alignment "<<align<<", must be index or poscounter");
+	
+	vector< unique_ptr<column_reader> > readers;
+	unordered_map<string, column_reader*> vars;
+	vector<scan_column> cols;
+	vector<string> names;
+	for (size_t i = 0; i < operands.size(); i += 2) {
+		string name = operands.getString(i);
+		SWList spec = operands.getList(i+1);
+		if (spec.size() < 1 || spec.size() > 2) STHROW("Operand "<<name<<" must be given as path or {path member}");
+		string path = spec.getString(0);
+		string member = spec.size() > 1 ? spec.getString(1) : string();
+		
+		if (align == "index") {
+			readers.push_back(unique_ptr<column_reader>(new h5_column_reader(file, path.c_str(), member)));
+			vars[name] = readers.back().get();
+		} else {
+			if (!member.empty()) STHROW("Members can't be selected for alignment on the PosCounter");
+			cols.push_back(scan_column());
+			read_scan_column(file, path, dup_mean, cols.back());
+			names.push_back(name);
+		}
+	}
+
+	size_t n;
+	if (align == "index") return compute_internal(expression, vars, n);
+
+	// evaluate on the rows which are present in all operands
+	vector<long long> keys;
+	vector< vector<double> > table;
+	join_scan_columns(cols, false, keys, table);
+	for (size_t c = 0; c < cols.size(); c++) {
+		readers.push_back(unique_ptr<column_reader>(new memory_column_reader(table[c])));
+		vars[names[c]] = readers.back().get();
+	}
+	
+	SWDict result = compute_internal(expression, vars, n);
+	// diff() shortens the result
+	keys.resize(n);
+	result.insert("PosCounter", make_packed("int64", vector<long>(1, keys.size()), keys));
+	return result;
+}
+
+// name of a native numeric type for packed arrays, NULL if not supported
+static const char * h5_typename(hid_t native) {
+	size_t size = H5Tget_size(native);
+	switch (H5Tget_class(native)) {
+		case H5T_INTEGER: {
+			bool sign = H5Tget_sign(native) == H5T_SGN_2;
+			switch (size) {
+				case 1: return sign ? "int8" : "uint8";
+				case 2: return sign ? "int16" : "uint16";
+				case 4: return sign ? "int32" : "uint32";
+				case 8: return sign ? "int64" : "uint64";
+				default: return NULL;
+			}
+		}
+		case H5T_FLOAT: {
+			if (size == 4) return "float32";
+			if (size == 8) return "float64";
+			return NULL;
+		}
+		default: return NULL;
+	}
+}
+
+// position of frame k in a 2D image or a 3D stack of images
+static void eval_frame(const my_dspaceinfo& dinfo, long frame, const char *path, hsize_t& offset, hsize_t& ny, hsize_t& nx) {
+	if (dinfo.rank == 2) {
+		if (frame != 0) STHROW("Data set "<<path<<" is a single image, can't select frame "<<frame);
+		ny = dinfo.extents[0];
+		nx = dinfo.extents[1];
+		offset = 0;
+	} else if (dinfo.rank == 3) {
+		if (frame < 0 || hsize_t(frame) >= dinfo.extents[0]) {
+			STHROW("Frame "<<frame<<" out of range, data set "<<path<<" has "<<dinfo.extents[0]<<" frames");
+		}
+		ny = dinfo.extents[1];
+		nx = dinfo.extents[2];
+		offset = frame * ny * nx;
+	} else {
+		STHROW("Data set "<<path<<" has rank "<<dinfo.rank<<", expected an image (2) or image stack (3)");
+	}
+}
+
+SWDict H5pp::readframe(const char *path, long frame) {
+	// frame in the native data type of the file
+	hid_t dset = H5Dopen(file, path, H5P_DEFAULT);
+	if (dset < 0) STHROW("Can't open data set "<<path);
+	hid_t dspace = H5Dget_space(dset);
+	hid_t dtype = H5Dget_type(dset);
+	hid_t native = H5Tget_native_type(dtype, H5T_DIR_ASCEND);
+
+	my_dspaceinfo dinfo;
+	eval_h5_dspace(dspace, dinfo);
+	const char *typname = h5_typename(native);
+	if (!typname) {
+		// e.g. long double, converted by HDF5
+		H5Tclose(native);
+		native = H5Tcopy(H5T_NATIVE_DOUBLE);
+		typname = "float64";
+	}
+	// raw data in the file, if it can be mapped
+	h5_raw_location rawdata(dset, dtype, native);
+	H5Tclose(dtype);
+
+	try {
+		hsize_t offset, ny, nx;
+		eval_frame(dinfo, frame, path, offset, ny, nx);
+		H5T_class_t tclass = H5Tget_class(native);
+		if (tclass != H5T_INTEGER && tclass != H5T_FLOAT) STHROW("Data set "<<path<<" is not numeric");
+		
+		vector<hsize_t> start(dinfo.rank, 0), count(dinfo.extents);
+		if (dinfo.rank == 3) {
+			start[0] = frame;
+			count[0] = 1;
+		}
+		vector<long> shape;
+		shape.push_back(ny);
+		shape.push_back(nx);
+		hsize_t nelements = ny * nx;
+		size_t elsize = H5Tget_size(native);
+		h5_mapping mapping(&rawdata, offset*elsize, nelements*elsize);
+		SWDict result;
+		if (mapping.valid()) {
+			// straight from the file into the byte array
+			result = make_packed(typname, shape, mapping.ptr(), nelements*elsize);
+		} else {
+			H5Sselect_hyperslab(dspace, H5S_SELECT_SET, &start[0], NULL, &count[0], NULL);
+			hid_t mspace = H5Screate_simple(1, &nelements, NULL);
+			vector<unsigned char> buf(nelements * elsize);
+			herr_t status = H5Dread(dset, native, mspace, dspace, H5P_DEFAULT, buf.empty() ? NULL : &buf[0]);
+			H5Sclose(mspace);
+			if (status < 0) STHROW("Error reading frame "<<frame<<" of data set "<<path);
+			result = make_packed(typname, shape, buf);
+		}
+		H5Tclose(native);
+		H5Sclose(dspace);
+		H5Dclose(dset);
+		return result;
+	} catch (...) {
+		H5Tclose(native);
+		H5Sclose(dspace);
+		H5Dclose(dset);
+		throw;
+	}
+}
+
+SWDict H5pp::rebin(const char *path, size_t fy, size_t fx, const string& mode, long frame) {
+	// sum or mean over blocks of fy x fx pixels, incomplete blocks at the edges are dropped
+	if (fy == 0 || fx == 0) STHROW("Rebinning factors must be positive");
+	bool mean;
+	if (mode == "sum") mean = false;
+	else if (mode == "mean") mean = true;
+	else STHROW("Unknown rebinning mode "<<mode<<", must be sum or mean");
+
+	h5_column_reader reader(file, path, "");
+	hsize_t offset, ny, nx;
+	eval_frame(reader.dspace(), frame, path, offset, ny, nx);
+	
+	size_t oy = ny / fy, ox = nx / fx;
+	vector<double> result(oy * ox);
+	
+	// read whole groups of fy rows, about one stream block at a time
+	size_t groups = max<size_t>(1, streamblock / (fy * nx + 1));
+	vector<double> rows(groups * fy * nx);
+	vector<double> acc(nx);
+	for (size_t g0 = 0; g0 < oy; g0 += groups) {
+		size_t ng = min(groups, oy - g0);
+		if (ng * fy * nx == 0) break;
+		reader.read(offset + g0 * fy * nx, ng * fy * nx, &rows[0]);
+		for (size_t g = 0; g < ng; g++) {
+			const double *grp = &rows[g * fy * nx];
+			copy(grp, grp + nx, acc.begin());
+			for (size_t r = 1; r < fy; r++) {
+				kernel_binop(kernel_add, &acc[0], grp + r*nx, &acc[0], nx);
+			}
+			double *out = &result[(g0 + g) * ox];
+			for (size_t j = 0; j < ox; j++) {
+				double sum = 0.0;
+				for (size_t k = 0; k < fx; k++) sum += acc[j*fx + k];
+				out[j] = sum;
+			}
+		}
+	}
+
+	if (mean) {
+		double scale = 1.0 / (fy * fx);
+		for (size_t i = 0; i < result.size(); i++) result[i] *= scale;
+	}
+
+	vector<long> shape;
+	shape.push_back(oy);
+	shape.push_back(ox);
+	return make_packed("float64", shape, result);
+}
+
+SWDict H5pp::histogram(const char *path, size_t nbins, const SWList& range, long frame) {
+	// frame -1 means the whole data set
+	if (nbins == 0) STHROW("Number of bins must be positive");
+	if (range.size() != 0 && range.size() != 2) STHROW("Range must be empty or {min max}");
+	
+	h5_column_reader reader(file, path, "");
+	size_t first = 0, n = reader.size();
+	if (frame >= 0) {
+		hsize_t offset, ny, nx;
+		eval_frame(reader.dspace(), frame, path, offset, ny, nx);
+		first = offset;
+		n = ny * nx;
+	}
+
+	double lo, hi;
+	if (range.size() == 2) {
+		lo = range.getDouble(0);
+		hi = range.getDouble(1);
+	} else {
+		// automatic range from a first pass over the data
+		lo = numeric_limits<double>::infinity();
+		hi = -lo;
+		stream_blocks(reader, NULL, first, n, [&](size_t, const double *, const double *y, size_t count) {
+			kernel_minmax(y, count, lo, hi);
+		});
+		if (lo > hi) { lo = 0.0; hi = 1.0; }
+	}
+	if (!(hi >= lo)) STHROW("Invalid histogram range "<<lo<<" "<<hi);
+	if (hi == lo) hi = lo + 1.0;
+	
+	vector<long long> counts(nbins, 0);
+	size_t outside = 0, nans = 0;
+	double scale = nbins / (hi - lo);
+	stream_blocks(reader, NULL, first, n, [&](size_t, const double *, const double *y, size_t count) {
+		kernel_histogram(y, count, lo, scale, nbins, &counts[0], outside, nans);
+	});
+
+	vector<double> edges(nbins + 1);
+	for (size_t i = 0; i <= nbins; i++) edges[i] = lo + i * (hi - lo) / nbins;
+
+	SWDict result;
+	result.insert("edges", make_packed("float64", vector<long>(1, nbins + 1), edges));
+	result.insert("counts", make_packed("int64", vector<long>(1, nbins), counts));
+	result.insert("outside", outside);
+	result.insert("nans", nans);
+	return result;
+}
+
+// Multi-resolution pyramids of images for interactive zooming.
+// Level 0 is the image in the file, every further level halves both dimensions
+// by averaging 2x2 blocks, down to a single pixel. Levels from 1 on are kept 
+// in a process wide cache, the least recently used pyramids are spilled 
+// to disk or dropped when the cache exceeds its memory budget.
+struct pyramid_level {
+	size_t ny, nx;
+	vector<double> data;
+};
+
+struct pyramid_entry {
+	size_t ny, nx; // level 0
+	vector<pyramid_level> levels; // level 1 and up
+	size_t bytes;
+	bool spilled;
+	string spillfile;
+	unsigned long long lastuse;
+};
+
+static map<string, pyramid_entry> pyramids;
+static size_t pyramid_budget = size_t(512) << 20;
+static string pyramid_spilldir;
+static unsigned long long pyramid_clock = 0;
+
+static size_t pyramid_memory() {
+	size_t total = 0;
+	for (map<string, pyramid_entry>::iterator it = pyramids.begin(); it != pyramids.end(); ++it) {
+		if (!it->second.spilled) total += it->second.bytes;
+	}
+	return total;
+}
+
+static void pyramid_spill(const string& key, pyramid_entry& entry) {
+	ostringstream fname;
+	fname << pyramid_spilldir << "/pyramid-" << hex << hash<string>()(key) << ".bin";
+	entry.spillfile = fname.str();
+	FILE *f = fopen(entry.spillfile.c_str(), "wb");
+	bool ok = f != NULL;
+	for (size_t l = 0; ok && l < entry.levels.size(); l++) {
+		vector<double>& data = entry.levels[l].data;
+		ok = fwrite(&data[0], sizeof(double), data.size(), f) == data.size();
+	}
+	if (f) fclose(f);
+	if (!ok) STHROW("Can't write pyramid cache file "<<entry.spillfile);
+	for (size_t l = 0; l < entry.levels.size(); l++) vector<double>().swap(entry.levels[l].data);
+	entry.spilled = true;
+}
+
+static void pyramid_unspill(pyramid_entry& entry) {
+	FILE *f = fopen(entry.spillfile.c_str(), "rb");
+	bool ok = f != NULL;
+	for (size_t l = 0; ok && l < entry.levels.size(); l++) {
+		pyramid_level& level = entry.levels[l];
+		level.data.resize(level.ny * level.nx);
+		ok = fread(&level.data[0], sizeof(double), level.data.size(), f) == level.data.size();
+	}
+	if (f) fclose(f);
+	if (!ok) STHROW("Can't read pyramid cache file "<<entry.spillfile);
+	remove(entry.spillfile.c_str());
+	entry.spilled = false;
+}
+
+// evict least recently used pyramids other than keep until the budget is met
+static void pyramid_evict(const string& keep) {
+	while (pyramid_memory() > pyramid_budget) {
+		map<string, pyramid_entry>::iterator lru = pyramids.end();
+		for (map<string, pyramid_entry>::iterator it = pyramids.begin(); it != pyramids.end(); ++it) {
+			if (it->first == keep || it->second.spilled) continue;
+			if (lru == pyramids.end() || it->second.lastuse < lru->second.lastuse) lru = it;
+		}
+		if (lru == pyramids.end()) return;
+		if (pyramid_spilldir.empty()) {
+			pyramids.erase(lru);
+		} else {
+			pyramid_spill(lru->first, lru->second);
+		}
+	}
+}
+
+// average 2x2 blocks of one or two rows of width nx into (nx+1)/2 values.
+// Blocks at odd edges average the pixels present
+static void downsample_rows(const double *row0, const double *row1, size_t nx, double *sum, double *out) {
+	double scale = 0.5;
+	if (row1) {
+		kernel_binop(kernel_add, row0, row1, sum, nx);
+		scale = 0.25;
+	} else {
+		copy(row0, row0 + nx, sum);
+	}
+	size_t half = nx / 2;
+	for (size_t j = 0; j < half; j++) out[j] = (sum[2*j] + sum[2*j+1]) * scale;
+	if (nx % 2) out[half] = sum[nx-1] * scale * 2.0;
+}
+
+static string pyramid_key(hid_t file, const char *path, long frame) {
+	// the file is identified by name, size and modification time,
+	// such that a rewritten file gets a new pyramid
+	ssize_t len = H5Fget_name(file, NULL, 0);
+	string fname(len > 0 ? len : 0, '\0');
+	if (len > 0) H5Fget_name(file, &fname[0], len + 1);
+	
+	ostringstream key;
+	key << fname << '\n';
+	struct stat st;
+	if (stat(fname.c_str(), &st) == 0) {
+		key << st.st_dev << ':' << st.st_ino << ':' << st.st_size << ':' << st.st_mtime;
+	}
+	key << '\n' << path << '\n' << frame;
+	return key.str();
+}
+
+static pyramid_entry& pyramid_get(hid_t file, const char *path, long frame) {
+	string key = pyramid_key(file, path, frame);
+	map<string, pyramid_entry>::iterator it = pyramids.find(key);
+	if (it != pyramids.end()) {
+		pyramid_entry& entry = it->second;
+		entry.lastuse = ++pyramid_clock;
+		if (entry.spilled) {
+			pyramid_unspill(entry);
+			pyramid_evict(key);
+		}
+		return entry;
+	}
+
+	h5_column_reader reader(file, path, "");
+	hsize_t offset, ny, nx;
+	eval_frame(reader.dspace(), frame, path, offset, ny, nx);
+
+	pyramid_entry entry;
+	entry.ny = ny;
+	entry.nx = nx;
+	entry.bytes = 0;
+	entry.spilled = false;
+	entry.lastuse = ++pyramid_clock;
+
+	// an empty frame has no further levels
+	if (ny > 0 && nx > 0 && (ny > 1 || nx > 1)) {
+		// level 1 is computed from pairs of rows streamed from the file
+		pyramid_level level;
+		level.ny = (ny + 1) / 2;
+		level.nx = (nx + 1) / 2;
+		level.data.resize(level.ny * level.nx);
+		size_t pairs = max<size_t>(1, streamblock / (2 * nx));
+		vector<double> rows(2 * pairs * nx), sum(nx);
+		for (size_t r = 0; r < ny; r += 2 * pairs) {
+			size_t nrows = min<size_t>(2 * pairs, ny - r);
+			reader.read(offset + r * nx, nrows * nx, &rows[0]);
+			for (size_t k = 0; k < nrows; k += 2) {
+				const double *row1 = (k + 1 < nrows) ? &rows[(k+1) * nx] : NULL;
+				downsample_rows(&rows[k * nx], row1, nx, &sum[0], &level.data[(r + k) / 2 * level.nx]);
+			}
+		}
+		entry.levels.push_back(level);
+	}
+
+	while (!entry.levels.empty() && (entry.levels.back().ny > 1 || entry.levels.back().nx > 1)) {
+		const pyramid_level& src = entry.levels.back();
+		pyramid_level level;
+		level.ny = (src.ny + 1) / 2;
+		level.nx = (src.nx + 1) / 2;
+		level.data.resize(level.ny * level.nx);
+		vector<double> sum(src.nx);
+		for (size_t r = 0; r < src.ny; r += 2) {
+			const double *row1 = (r + 1 < src.ny) ? &src.data[(r+1) * src.nx] : NULL;
+			downsample_rows(&src.data[r * src.nx], row1, src.nx, &sum[0], &level.data[r / 2 * level.nx]);
+		}
+		entry.levels.push_back(level);
+	}
+
+	for (size_t l = 0; l < entry.levels.size(); l++) entry.bytes += entry.levels[l].data.size() * sizeof(double);
+	pyramid_entry& result = pyramids[key];
+	swap(result, entry);
+	pyramid_evict(key);
+	return result;
+}
+
+SWDict H5pp::pyramid(const char *path, long frame) {
+	pyramid_entry& entry = pyramid_get(file, path, frame);
+	SWList levels;
+	SWList shape0;
+	shape0.push_back(entry.ny);
+	shape0.push_back(entry.nx);
+	levels.push_back(shape0);
+	for (size_t l = 0; l < entry.levels.size(); l++) {
+		SWList shape;
+		shape.push_back(entry.levels[l].ny);
+		shape.push_back(entry.levels[l].nx);
+		levels.push_back(shape);
+	}
+	SWDict result;
+	result.insert("levels", levels);
+	result.insert("bytes", entry.bytes);
+	return result;
+}
+
+SWDict H5pp::tile(const char *path, size_t level, long y0, long x0, long ny, long nx, long frame) {
+	// region is clipped to the image at this level
+	pyramid_entry& entry = pyramid_get(file, path, frame);
+	if (level > entry.levels.size()) STHROW("Level "<<level<<" out of range, pyramid has "<<entry.levels.size()+1<<" levels");
+	
+	size_t height = level == 0 ? entry.ny : entry.levels[level-1].ny;
+	size_t width = level == 0 ? entry.nx : entry.levels[level-1].nx;
+	if (y0 < 0 || x0 < 0 || ny < 0 || nx < 0) STHROW("Negative tile position or size");
+	size_t ty = min<size_t>(ny, y0 < long(height) ? height - y0 : 0);
+	size_t tx = min<size_t>(nx, x0 < long(width) ? width - x0 : 0);
+	
+	vector<double> data(ty * tx);
+	if (level == 0) {
+		// full resolution is read from the file
+		h5_column_reader reader(file, path, "");
+		vector<hsize_t> start, count;
+		if (reader.dspace().rank == 3) {
+			start.push_back(frame);
+			count.push_back(1);
+		}
+		start.push_back(y0);
+		start.push_back(x0);
+		count.push_back(ty);
+		count.push_back(tx);
+		if (!data.empty()) reader.read_box(start, count, &data[0]);
+	} else {
+		const pyramid_level& src = entry.levels[level-1];
+		for (size_t r = 0; r < ty; r++) {
+			const double *row = &src.data[(y0 + r) * src.nx + x0];
+			copy(row, row + tx, &data[r * tx]);
+		}
+	}
+	
+	vector<long> shape;
+	shape.push_back(ty);
+	shape.push_back(tx);
+	return make_packed("float64", shape, data);
+}
+
+void pyramid_cache(size_t maxbytes, const string& spilldir) {
+	pyramid_budget = maxbytes;
+	pyramid_spilldir = spilldir;
+	pyramid_evict("");
+}
+
+void pyramid_clear() {
+	for (map<string, pyramid_entry>::iterator it = pyramids.begin(); it != pyramids.end(); ++it) {
+		if (it->second.spilled) remove(it->second.spillfile.c_str());
+	}
+	pyramids.clear();
+}
+
+void readdatatype5_internal(hid_t loc_id, const char *name, SWDict& datatypedata) {	
+	SWDict attrs;
+	/* readattr5_internal(loc_id, attrs); */
+
+	datatypedata.insert("type", "DATATYPE");
+	datatypedata.insert("name", name);
+	datatypedata.insert("attrs", attrs);
+
+	// now read the data
+	SWList data;
+	datatypedata.insert("data", data);
+ }
+
+herr_t dumpattrib_callback (hid_t loc_id, const char *attr_name, const H5A_info_t *info, void *attrdictptr);
+
+
+void readattr5_internal(hid_t resource_id, SWDict& attrs) {
+	// start iteration over attributes and insert into dict
+	H5Aiterate(resource_id, H5_INDEX_CRT_ORDER, H5_ITER_NATIVE, NULL, dumpattrib_callback, &attrs);
+}
+
+
+herr_t dumpattrib_callback (hid_t loc_id, const char *attr_name, const H5A_info_t *info, void *attrdictptr) {
+	SWDict & attrs = *(reinterpret_cast<SWDict*>(attrdictptr));
+	PERF_COUNT(attributes, 1);
+	hid_t attr_id = H5Aopen(loc_id, attr_name, H5P_DEFAULT);
+	hid_t dtype = H5Aget_type(attr_id);
+	hid_t dspace = H5Aget_space(attr_id);
+	
+	my_dspaceinfo dinfo;
+	eval_h5_dspace(dspace, dinfo);
+
+	my_typeinfo tinfo;
+	tinfo.native_dtype = H5Tget_native_type(dtype, H5T_DIR_ASCEND);
+	eval_h5_dtype<h5a_api>(tinfo);
+
+	attrs.insert(attr_name, importdata<h5a_api>(attr_id, tinfo, dinfo));
+
+	// close type&space
+	H5Tclose(tinfo.native_dtype);
+	H5Tclose(dtype);
+	H5Sclose(dspace);
+	// close data set
+	H5Aclose(attr_id);
+
+
+	return 0; //Success, continue
+}
+
+// JSON export, same structure as dump but written directly to a file.
+// Data sets are transferred in blocks, so that memory stays bounded
+static void json_element5(json_writer& w, const char *dbuf, my_dtype type, size_t size) {
+	switch (type) {
+		case MY_NATIVE_CHAR: w.number((long long)*reinterpret_cast<const char*>(dbuf)); break;
+		case MY_NATIVE_SHORT: w.number((long long)*reinterpret_cast<const short*>(dbuf)); break;
+		case MY_NATIVE_INT: w.number((long long)*reinterpret_cast<const int*>(dbuf)); break;
+		case MY_NATIVE_LONG: w.number((long long)*reinterpret_cast<const long*>(dbuf)); break;
+		case MY_NATIVE_LLONG: w.number(*reinterpret_cast<const long long*>(dbuf)); break;
+		case MY_NATIVE_UCHAR: w.number((long long)*reinterpret_cast<const unsigned char*>(dbuf)); break;
+		case MY_NATIVE_USHORT: w.number((long long)*reinterpret_cast<const unsigned short*>(dbuf)); break;
+		case MY_NATIVE_UINT: w.number((long long)*reinterpret_cast<const unsigned int*>(dbuf)); break;
+		case MY_NATIVE_ULONG: w.number((unsigned long long)*reinterpret_cast<const unsigned long*>(dbuf)); break;
+		case MY_NATIVE_ULLONG: w.number(*reinterpret_cast<const unsigned long long*>(dbuf)); break;
+		case MY_NATIVE_FLOAT: w.number((double)*reinterpret_cast<const float*>(dbuf)); break;
+		case MY_NATIVE_DOUBLE: w.number(*reinterpret_cast<const double*>(dbuf)); break;
+		case MY_NATIVE_LDOUBLE: w.number((double)*reinterpret_cast<const long double*>(dbuf)); break;
+		case MY_NATIVE_C_S1: {
+			const char *end = static_cast<const char*>(memchr(dbuf, '\0', size));
+			w.string(dbuf, end ? end - dbuf : size);
+			break;
+		}
+		case MY_NATIVE_VLSTR: {
+			const char *str = *reinterpret_cast<const char * const *>(dbuf);
+			if (str) w.string(str, strlen(str)); else w.string("", 0);
+			break;
+		}
+		default: w.string("???", 3);
+	}
+}
+
+// all elements of a data set or attribute as a JSON array, or a single value for scalar attributes
+template <h5_api API>
+static void json_data5(json_writer& w, hid_t resource_id, hid_t space, my_typeinfo& typeinfo, const my_dspaceinfo& dinfo) {
+	vector<ssize_t> eloffsets;
+	vector<my_dtype> eltypes;
+	vector<size_t> elsizes;
+	bool hasvlstr = eval_h5_members(typeinfo, eloffsets, eltypes, elsizes);
+	bool scalar = (API==h5a_api && dinfo.nelements==1);
+
+	if (!scalar) w.put('[');
+	bool first = true;
+	size_t block = (API==h5a_api || typeinfo.elsize == 0) ? dinfo.nelements : max<size_t>(1, (1 << 20) / typeinfo.elsize);
+	vector<char> buf;
+	for (size_t start = 0; start < dinfo.nelements; start += block) {
+		size_t count = min(block, size_t(dinfo.nelements - start));
+		buf.assign(count * typeinfo.elsize, 0);
+		hid_t mspace;
+		herr_t status;
+		if (API==h5a_api) {
+			mspace = H5Scopy(space);
+			status = H5Aread(resource_id, typeinfo.native_dtype, &buf[0]);
+		} else {
+			hsize_t ncount = count;
+			mspace = H5Screate_simple(1, &ncount, NULL);
+			if (dinfo.rank == 0) {
+				H5Sselect_all(space);
+			} else {
+				vector<hsize_t> offset(dinfo.rank, 0);
+				bool firstbox = true;
+				select_flat_range(space, dinfo, 0, offset, start, start + count, firstbox);
+			}
+			status = H5Dread(resource_id, typeinfo.native_dtype, mspace, space, H5P_DEFAULT, &buf[0]);
+		}
+		if (status < 0) {
+			H5Sclose(mspace);
+			STHROW("Error reading data for JSON export");
+		}
+
+		for (char *el = &buf[0]; el < &buf[0] + buf.size(); el += typeinfo.elsize) {
+			for (size_t ind=0; ind<typeinfo.nmembers; ind++) {
+				if (scalar && ind + 1 < typeinfo.nmembers) continue; // like dump, the last member
+				if (!first) w.put(',');
+				first = false;
+				json_element5(w, el + eloffsets[ind], eltypes[ind], elsizes[ind]);
+			}
+		}
+
+		if (hasvlstr) H5Dvlen_reclaim(typeinfo.native_dtype, mspace, H5P_DEFAULT, &buf[0]);
+		H5Sclose(mspace);
+	}
+	if (!scalar) w.put(']');
+	else if (first) w.put("[]", 2);
+}
+
+struct json_attrdata {
+	json_writer *w;
+	bool first;
+};
+
+extern "C" herr_t jsonattrib_callback (hid_t loc_id, const char *attr_name, const H5A_info_t *info, void *data);
+
+herr_t jsonattrib_callback (hid_t loc_id, const char *attr_name, const H5A_info_t *info, void *data) {
+	json_attrdata& adata = *(reinterpret_cast<json_attrdata*>(data));
+	hid_t attr_id = H5Aopen(loc_id, attr_name, H5P_DEFAULT);
+	hid_t dtype = H5Aget_type(attr_id);
+	hid_t dspace = H5Aget_space(attr_id);
+	
+	my_dspaceinfo dinfo;
+	eval_h5_dspace(dspace, dinfo);
+
+	my_typeinfo tinfo;
+	tinfo.native_dtype = H5Tget_native_type(dtype, H5T_DIR_ASCEND);
+	eval_h5_dtype<h5a_api>(tinfo);
+
+	herr_t result = 0;
+	try {
+		if (!adata.first) adata.w->put(',');
+		adata.first = false;
+		adata.w->key(attr_name);
+		json_data5<h5a_api>(*adata.w, attr_id, dspace, tinfo, dinfo);
+	} catch (...) {
+		result = -1;
+	}
+
+	H5Tclose(tinfo.native_dtype);
+	H5Tclose(dtype);
+	H5Sclose(dspace);
+	H5Aclose(attr_id);
+	return result;
+}
+
+static void json_attrs5(json_writer& w, hid_t resource_id) {
+	json_attrdata adata = { &w, true };
+	w.key("attrs");
+	w.put('{');
+	if (H5Aiterate(resource_id, H5_INDEX_CRT_ORDER, H5_ITER_NATIVE, NULL, jsonattrib_callback, &adata) < 0) {
+		STHROW("Error writing attributes");
+	}
+	w.put('}');
+}
+
+// header of every object: type, name, path (NDJSON only) and attributes
+static void json_header5(json_writer& w, const char *type, const char *name, const string& path, bool ndjson) {
+	w.key("type");
+	w.string(type, strlen(type));
+	w.put(',');
+	w.key("name");
+	w.string(name, strlen(name));
+	w.put(',');
+	if (ndjson) {
+		w.key("path");
+		w.string(path);
+		w.put(',');
+	}
+}
+
+static void json_dataset5(json_writer& w, hid_t loc_id, const char *name, const string& path, bool ndjson) {
+	hid_t dset = H5Dopen(loc_id, name, H5P_DEFAULT);
+	if (dset < 0) STHROW("Can't open data set "<<path);
+	hid_t dspace = H5Dget_space(dset);
+	hid_t dtype  = H5Dget_type(dset);
+	my_typeinfo tinfo;
+	tinfo.native_dtype = H5Tget_native_type(dtype, H5T_DIR_ASCEND);
+
+	try {
+		w.put('{');
+		json_header5(w, "DATASET", name, path, ndjson);
+		json_attrs5(w, dset);
+
+		my_dspaceinfo dinfo;
+		eval_h5_dspace(dspace, dinfo);
+		w.put(',');
+		w.key("dspace");
+		w.put('[');
+		for (int d = 0; d < dinfo.rank; d++) {
+			if (d > 0) w.put(',');
+			w.number((unsigned long long)dinfo.extents[d]);
+		}
+		w.put(']');
+		w.put(',');
+		w.key("ndata");
+		w.number((unsigned long long)dinfo.nelements);
+
+		// same description as dump
+		w.put(',');
+		w.key("dtype");
+		w.put('[');
+		SWList dtype_list = eval_h5_dtype<h5d_api>(tinfo);
+		for (size_t i = 0; i < dtype_list.size(); i++) {
+			if (i > 0) w.put(',');
+			w.string(dtype_list.getString(i));
+		}
+		w.put(']');
+
+		w.put(',');
+		w.key("data");
+		json_data5<h5d_api>(w, dset, dspace, tinfo, dinfo);
+		w.put('}');
+	} catch (...) {
+		H5Tclose(tinfo.native_dtype);
+		H5Tclose(dtype);
+		H5Sclose(dspace);
+		H5Dclose(dset);
+		throw;
+	}
+	H5Tclose(tinfo.native_dtype);
+	H5Tclose(dtype);
+	H5Sclose(dspace);
+	H5Dclose(dset);
+}
+
+static void json_group5(json_writer& w, hid_t loc_id, const char *name, const string& path, int maxlevel, bool ndjson);
+
+struct json_walkdata {
+	json_writer *w;
+	int level;
+	bool ndjson;
+	string path;
+	bool first;
+	string error;
+};
+
+extern "C" herr_t jsongroup_callback (hid_t loc_id, const char *name, const H5L_info_t *info, void *operator_data);
+
+herr_t jsongroup_callback (hid_t loc_id, const char *name, const H5L_info_t *info, void *operator_data) {
+	json_walkdata& wdata = *(reinterpret_cast<json_walkdata*>(operator_data));
+	json_writer& w = *wdata.w;
+	string path = wdata.path == "/" ? "/" + string(name) : wdata.path + "/" + name;
+
+	try {
+		if (wdata.ndjson) {
+			// one line per object, groups are followed by their contents
+			if (info->type != H5L_TYPE_SOFT) {
+				H5O_info_t infobuf;
+				if (H5Oget_info_by_name(loc_id, name, &infobuf, H5O_INFO_BASIC, H5P_DEFAULT) < 0) return -1;
+				if (infobuf.type == H5O_TYPE_GROUP) {
+					json_group5(w, loc_id, name, path, wdata.level, true);
+					return 0;
+				}
+			}
+		} else {
+			if (!wdata.first) w.put(',');
+			wdata.first = false;
+			w.key(name);
+		}
+
+		if (info->type == H5L_TYPE_SOFT) {
+			vector<char> targbuf(info->u.val_size+1);
+			if (H5Lget_val(loc_id, name, &targbuf[0], info->u.val_size, H5P_DEFAULT) < 0) return -1;
+			w.put('{');
+			json_header5(w, "SOFTLINK", name, path, wdata.ndjson);
+			w.key("attrs");
+			w.put("{},", 3);
+			w.key("data");
+			w.string(&targbuf[0], strlen(&targbuf[0]));
+			w.put('}');
+		} else {
+			H5O_info_t infobuf;
+			if (H5Oget_info_by_name(loc_id, name, &infobuf, H5O_INFO_BASIC, H5P_DEFAULT) < 0) return -1;
+			switch (infobuf.type) {
+				case H5O_TYPE_GROUP:
+					json_group5(w, loc_id, name, path, wdata.level, false);
+					break;
+				case H5O_TYPE_DATASET:
+					json_dataset5(w, loc_id, name, path, wdata.ndjson);
+					break;
+				case H5O_TYPE_NAMED_DATATYPE:
+					w.put('{');
+					json_header5(w, "DATATYPE", name, path, wdata.ndjson);
+					w.key("attrs");
+					w.put("{},", 3);
+					w.key("data");
+					w.put("[]}", 3);
+					break;
+				default:
+					w.put('{');
+					w.key("type");
+					w.put("\"UNKNOWN\",", 10);
+					w.key("name");
+					w.string(name, strlen(name));
+					w.put('}');
+			}
+		}
+		if (wdata.ndjson) w.put('\n');
+	} catch (const exception& e) {
+		wdata.error = e.what();
+		return -1;
+	}
+	return 0;
+}
+
+static void json_group5(json_writer& w, hid_t loc_id, const char *name, const string& path, int maxlevel, bool ndjson) {
+	hid_t group_id = H5Gopen(loc_id, name, H5P_DEFAULT);
+	if (group_id < 0) STHROW("Can't open group "<<path);
+
+	json_walkdata wdata;
+	wdata.w = &w;
+	wdata.level = maxlevel - 1;
+	wdata.ndjson = ndjson;
+	wdata.path = path;
+	wdata.first = true;
+	
+	herr_t status = 0;
+	try {
+		w.put('{');
+		json_header5(w, "GROUP", name, path, ndjson);
+		json_attrs5(w, group_id);
+		if (ndjson) {
+			w.put("}\n", 2);
+		} else {
+			w.put(',');
+			w.key("data");
+			w.put('{');
+		}
+		if (wdata.level != 0) {
+			status = H5Literate(group_id, H5_INDEX_NAME, H5_ITER_NATIVE, NULL, jsongroup_callback, &wdata);
+		}
+		if (!ndjson) w.put("}}", 2);
+	} catch (...) {
+		H5Gclose(group_id);
+		throw;
+	}
+	H5Gclose(group_id);
+	if (status < 0) {
+		if (!wdata.error.empty()) STHROW(wdata.error);
+		STHROW("Error exporting group "<<path);
+	}
+}
+
+void H5pp::writejson(const char *fname, const string& format, int maxlevel, const char *root) {
+	bool ndjson;
+	if (format == "json") ndjson = false;
+	else if (format == "ndjson") ndjson = true;
+	else STHROW("Unknown format "<<format<<", must be json or ndjson");
+
+	json_writer w(fname);
+	json_group5(w, file, root, root, maxlevel, ndjson);
+	if (!ndjson) w.put('\n');
+	w.close();
+}
+
+// Content fingerprints: XXH64 hashes of the native values and types of the
+// data sets, of the attributes of every object and of whole subtrees.
+// Attributes and group members are hashed in name order, such that the
+// creation order doesn't matter, and values are compared after conversion
+// to the native type, such that the byte order on disk doesn't matter either
+struct fp_node {
+	string type;
+	unsigned long long hash;  // the whole object including attributes and members
+	unsigned long long attrs;
+	unsigned long long data;  // type, shape and values of a data set, target of a link
+	map<string, fp_node> members;
+};
+
+static void fp_string(xxh64& h, const char *s, size_t len) {
+	unsigned long long n = len;
+	h.update(&n, sizeof(n));
+	h.update(s, len);
+}
+
+static void fp_value(xxh64& h, unsigned long long v) {
+	h.update(&v, sizeof(v));
+}
+
+// type, shape and values of a data set or attribute, read in blocks
+template <h5_api API>
+static void fp_data5(xxh64& h, hid_t resource_id, hid_t space, my_typeinfo& typeinfo, const my_dspaceinfo& dinfo) {
+	SWList description = eval_h5_dtype<API>(typeinfo);
+	vector<ssize_t> eloffsets;
+	vector<my_dtype> eltypes;
+	vector<size_t> elsizes;
+	bool hasvlstr = eval_h5_members(typeinfo, eloffsets, eltypes, elsizes);
+
+	// other variable length members hold pointers, their values are skipped like in dump
+	vector<bool> skip(typeinfo.nmembers, false);
+	bool hasvlen = false;
+	for (size_t ind = 0; ind < typeinfo.nmembers; ind++) {
+		hid_t mtype = typeinfo.isatomic ? H5Tcopy(typeinfo.native_dtype) : H5Tget_member_type(typeinfo.native_dtype, ind);
+		skip[ind] = eltypes[ind] != MY_NATIVE_VLSTR && H5Tdetect_class(mtype, H5T_VLEN) > 0;
+		hasvlen = hasvlen || skip[ind];
+		H5Tclose(mtype);
+		if (!typeinfo.isatomic) fp_string(h, description.getString(ind).c_str(), description.getString(ind).size());
+		fp_value(h, eltypes[ind]);
+		fp_value(h, elsizes[ind]);
+	}
+	fp_value(h, dinfo.rank);
+	for (int d = 0; d < dinfo.rank; d++) fp_value(h, dinfo.extents[d]);
+
+	size_t block = (API==h5a_api || typeinfo.elsize == 0) ? dinfo.nelements : max<size_t>(1, (1 << 20) / typeinfo.elsize);
+	vector<char> buf;
+	for (size_t start = 0; start < dinfo.nelements; start += block) {
+		size_t count = min(block, size_t(dinfo.nelements - start));
+		buf.assign(count * typeinfo.elsize, 0);
+		hid_t mspace;
+		herr_t status;
+		{
+			perf_timer timer(&perf_counters::t_io);
+			if (API==h5a_api) {
+				mspace = H5Scopy(space);
+				status = H5Aread(resource_id, typeinfo.native_dtype, &buf[0]);
+			} else {
+				hsize_t ncount = count;
+				mspace = H5Screate_simple(1, &ncount, NULL);
+				if (dinfo.rank == 0) {
+					H5Sselect_all(space);
+				} else {
+					vector<hsize_t> offset(dinfo.rank, 0);
+					bool firstbox = true;
+					select_flat_range(space, dinfo, 0, offset, start, start + count, firstbox);
+				}
+				status = H5Dread(resource_id, typeinfo.native_dtype, mspace, space, H5P_DEFAULT, &buf[0]);
+			}
+		}
+		if (status < 0) {
+			H5Sclose(mspace);
+			STHROW("Error reading data for the fingerprint");
+		}
+		PERF_COUNT(bytes, buf.size());
+
+		if (!hasvlstr && !hasvlen) {
+			h.update(&buf[0], buf.size());
+		} else {
+			for (char *el = &buf[0]; el < &buf[0] + buf.size(); el += typeinfo.elsize) {
+				for (size_t ind=0; ind<typeinfo.nmembers; ind++) {
+					if (skip[ind]) continue;
+					if (eltypes[ind] == MY_NATIVE_VLSTR) {
+						const char *str = *reinterpret_cast<const char * const *>(el + eloffsets[ind]);
+						fp_string(h, str ? str : "", str ? strlen(str) : 0);
+					} else {
+						h.update(el + eloffsets[ind], elsizes[ind]);
+					}
+				}
+			}
+			H5Dvlen_reclaim(typeinfo.native_dtype, mspace, H5P_DEFAULT, &buf[0]);
+		}
+		H5Sclose(mspace);
+	}
+}
+
+struct fp_attrdata {
+	map<string, unsigned long long> hashes;
+	string error;
+};
+
+extern "C" herr_t fpattrib_callback (hid_t loc_id, const char *attr_name, const H5A_info_t *info, void *data);
+
+herr_t fpattrib_callback (hid_t loc_id, const char *attr_name, const H5A_info_t *info, void *data) {
+	fp_attrdata& adata = *(reinterpret_cast<fp_attrdata*>(data));
+	PERF_COUNT(attributes, 1);
+	hid_t attr_id = H5Aopen(loc_id, attr_name, H5P_DEFAULT);
+	hid_t dtype = H5Aget_type(attr_id);
+	hid_t dspace = H5Aget_space(attr_id);
+
+	my_dspaceinfo dinfo;
+	eval_h5_dspace(dspace, dinfo);
+
+	my_typeinfo tinfo;
+	tinfo.native_dtype = H5Tget_native_type(dtype, H5T_DIR_ASCEND);
+
+	herr_t result = 0;
+	try {
+		xxh64 h;
+		fp_data5<h5a_api>(h, attr_id, dspace, tinfo, dinfo);
+		adata.hashes[attr_name] = h.digest();
+	} catch (const exception& e) {
+		adata.error = e.what();
+		result = -1;
+	}
+
+	H5Tclose(tinfo.native_dtype);
+	H5Tclose(dtype);
+	H5Sclose(dspace);
+	H5Aclose(attr_id);
+	return result;
+}
+
+static unsigned long long fp_attrs5(hid_t resource_id) {
+	fp_attrdata adata;
+	if (H5Aiterate(resource_id, H5_INDEX_NAME, H5_ITER_INC, NULL, fpattrib_callback, &adata) < 0) {
+		if (!adata.error.empty()) STHROW(adata.error);
+		STHROW("Error reading attributes");
+	}
+	xxh64 h;
+	for (map<string, unsigned long long>::iterator it = adata.hashes.begin(); it != adata.hashes.end(); ++it) {
+		fp_string(h, it->first.c_str(), it->first.size());
+		fp_value(h, it->second);
+	}
+	return h.digest();
+}
+
+// hash of everything, computed after the parts
+static void fp_finish(fp_node& node) {
+	xxh64 h;
+	h.update(node.type);
+	fp_value(h, node.attrs);
+	fp_value(h, node.data);
+	for (map<string, fp_node>::iterator it = node.members.begin(); it != node.members.end(); ++it) {
+		fp_string(h, it->first.c_str(), it->first.size());
+		fp_value(h, it->second.hash);
+	}
+	node.hash = h.digest();
+}
+
+static void fp_dataset5(hid_t loc_id, const char *name, const string& path, fp_node& node) {
+	hid_t dset = H5Dopen(loc_id, name, H5P_DEFAULT);
+	if (dset < 0) STHROW("Can't open data set "<<path);
+	hid_t dspace = H5Dget_space(dset);
+	hid_t dtype  = H5Dget_type(dset);
+	my_typeinfo tinfo;
+	tinfo.native_dtype = H5Tget_native_type(dtype, H5T_DIR_ASCEND);
+
+	try {
+		PERF_COUNT(objects, 1);
+		node.type = "DATASET";
+		node.attrs = fp_attrs5(dset);
+		my_dspaceinfo dinfo;
+		eval_h5_dspace(dspace, dinfo);
+		xxh64 h;
+		fp_data5<h5d_api>(h, dset, dspace, tinfo, dinfo);
+		node.data = h.digest();
+		fp_finish(node);
+	} catch (...) {
+		H5Tclose(tinfo.native_dtype);
+		H5Tclose(dtype);
+		H5Sclose(dspace);
+		H5Dclose(dset);
+		throw;
+	}
+	H5Tclose(tinfo.native_dtype);
+	H5Tclose(dtype);
+	H5Sclose(dspace);
+	H5Dclose(dset);
+}
+
+static void fp_group5(hid_t loc_id, const char *name, const string& path, fp_node& node);
+
+struct fp_walkdata {
+	fp_node *node;
+	string path;
+	string error;
+};
+
+extern "C" herr_t fpgroup_callback (hid_t loc_id, const char *name, const H5L_info_t *info, void *operator_data);
+
+herr_t fpgroup_callback (hid_t loc_id, const char *name, const H5L_info_t *info, void *operator_data) {
+	fp_walkdata& wdata = *(reinterpret_cast<fp_walkdata*>(operator_data));
+	string path = wdata.path == "/" ? "/" + string(name) : wdata.path + "/" + name;
+	fp_node& node = wdata.node->members[name];
+	node.attrs = 0;
+	node.data = 0;
+
+	try {
+		if (info->type == H5L_TYPE_SOFT) {
+			vector<char> targbuf(info->u.val_size+1);
+			if (H5Lget_val(loc_id, name, &targbuf[0], info->u.val_size, H5P_DEFAULT) < 0) return -1;
+			node.type = "SOFTLINK";
+			xxh64 h;
+			fp_string(h, &targbuf[0], strlen(&targbuf[0]));
+			node.data = h.digest();
+		} else {
+			H5O_info_t infobuf;
+			if (H5Oget_info_by_name(loc_id, name, &infobuf, H5O_INFO_BASIC, H5P_DEFAULT) < 0) return -1;
+			switch (infobuf.type) {
+				case H5O_TYPE_GROUP:
+					fp_group5(loc_id, name, path, node);
+					return 0;
+				case H5O_TYPE_DATASET:
+					fp_dataset5(loc_id, name, path, node);
+					return 0;
+				case H5O_TYPE_NAMED_DATATYPE:
+					node.type = "DATATYPE";
+					break;
+				default:
+					node.type = "UNKNOWN";
+			}
+		}
+		fp_finish(node);
+	} catch (const exception& e) {
+		wdata.error = e.what();
+		return -1;
+	}
+	return 0;
+}
+
+static void fp_group5(hid_t loc_id, const char *name, const string& path, fp_node& node) {
+	hid_t group_id = H5Gopen(loc_id, name, H5P_DEFAULT);
+	if (group_id < 0) STHROW("Can't open group "<<path);
+	PERF_COUNT(objects, 1);
+
+	fp_walkdata wdata;
+	wdata.node = &node;
+	wdata.path = path;
+	node.type = "GROUP";
+	node.data = 0;
+
+	herr_t status = 0;
+	try {
+		node.attrs = fp_attrs5(group_id);
+		status = H5Literate(group_id, H5_INDEX_NAME, H5_ITER_INC, NULL, fpgroup_callback, &wdata);
+	} catch (...) {
+		H5Gclose(group_id);
+		throw;
+	}
+	H5Gclose(group_id);
+	if (status < 0) {
+		if (!wdata.error.empty()) STHROW(wdata.error);
+		STHROW("Error reading group "<<path);
+	}
+	fp_finish(node);
+}
+
+static string fp_hex(unsigned long long hash) {
+	char buf[17];
+	snprintf(buf, sizeof(buf), "%016llx", hash);
+	return buf;
+}
+
+// same structure as dump: type, hash, attrs and data, which are the
+// members of groups down to maxlevel
+static SWDict fp_result(const fp_node& node, int maxlevel) {
+	SWDict result;
+	result.insert("type", node.type);
+	result.insert("hash", fp_hex(node.hash));
+	result.insert("attrs", fp_hex(node.attrs));
+	if (node.type == "GROUP") {
+		SWDict members;
+		if (maxlevel != 1) {
+			for (map<string, fp_node>::const_iterator it = node.members.begin(); it != node.members.end(); ++it) {
+				members.insert(it->first, fp_result(it->second, maxlevel - 1));
+			}
+		}
+		result.insert("data", members);
+	} else {
+		result.insert("data", fp_hex(node.data));
+	}
+	return result;
+}
+
+SWDict H5pp::fingerprint(int maxlevel, const char *root) {
+	perf_scope scope(perf);
+	fp_node node;
+	fp_group5(file, root, root, node);
+	return fp_result(node, maxlevel);
+}
+
+// the differing paths with what differs: type, attrs, data, or removed/added
+// for members which exist only in a or b
+static void fp_diff(const fp_node& a, const fp_node& b, const string& path, SWDict& result) {
+	if (a.hash == b.hash && a.type == b.type) return;
+	SWList what;
+	if (a.type != b.type) {
+		what.push_back("type");
+		result.insert(path, what);
+		return;
+	}
+	if (a.attrs != b.attrs) what.push_back("attrs");
+	if (a.data != b.data) what.push_back("data");
+	if (what.size() > 0) result.insert(path, what);
+
+	map<string, fp_node>::const_iterator ia = a.members.begin(), ib = b.members.begin();
+	while (ia != a.members.end() || ib != b.members.end()) {
+		int cmp = (ia == a.members.end()) ? 1 : (ib == b.members.end()) ? -1 : ia->first.compare(ib->first);
+		const string& name = cmp <= 0 ? ia->first : ib->first;
+		string mpath = path == "/" ? "/" + name : path + "/" + name;
+		if (cmp < 0) {
+			result.insert(mpath, SWList(vector<string>(1, "removed")));
+			++ia;
+		} else if (cmp > 0) {
+			result.insert(mpath, SWList(vector<string>(1, "added")));
+			++ib;
+		} else {
+			fp_diff(ia->second, ib->second, mpath, result);
+			++ia;
+			++ib;
+		}
+	}
+}
+
+SWDict H5pp::diff(H5pp *other, const char *root) {
+	if (!other) STHROW("No file to compare with");
+	fp_node a, b;
+	{
+		perf_scope scope(perf);
+		fp_group5(file, root, root, a);
+	}
+	{
+		perf_scope scope(other->perf);
+		fp_group5(other->file, root, root, b);
+	}
+	SWDict result;
+	fp_diff(a, b, root, result);
+	return result;
+}
+
+// rows of a data set as records of the native types. Compound members
+// become separate columns named path/member
+class h5_export_source : public export_source {
+	hid_t dset;
+	hid_t fspace;
+	hid_t memtype;
+
+	void cleanup() {
+		if (memtype >= 0) H5Tclose(memtype);
+		if (fspace >= 0) H5Sclose(fspace);
+		if (dset >= 0) H5Dclose(dset);
+	}
+
+public:
+	h5_export_source(hid_t loc_id, const char *dpath) : dset(-1), fspace(-1), memtype(-1) {
+		path = dpath;
+		dset = H5Dopen(loc_id, dpath, H5P_DEFAULT);
+		if (dset < 0) STHROW("Can't open data set "<<path);
+		fspace = H5Dget_space(dset);
+		my_dspaceinfo dinfo;
+		eval_h5_dspace(fspace, dinfo);
+		shape.assign(dinfo.extents.begin(), dinfo.extents.end());
+
+		hid_t dtype = H5Dget_type(dset);
+		hid_t native = H5Tget_native_type(dtype, H5T_DIR_ASCEND);
+		H5Tclose(dtype);
+		if (H5Tget_class(native) != H5T_COMPOUND) {
+			const char *typname = h5_typename(native);
+			memtype = native;
+			if (!typname) {
+				cleanup();
+				STHROW("Data set "<<path<<" is not numeric");
+			}
+			recsize = H5Tget_size(native);
+			columns.push_back(column{ path, typname, 0 });
+			return;
+		}
+
+		// the members packed into a record
+		int nmembers = H5Tget_nmembers(native);
+		vector<hid_t> mtypes;
+		vector<string> mnames;
+		recsize = 0;
+		for (int idx = 0; idx < nmembers; idx++) {
+			char *name = H5Tget_member_name(native, idx);
+			mnames.push_back(name);
+			free(name);
+			mtypes.push_back(H5Tget_member_type(native, idx));
+			const char *typname = h5_typename(mtypes.back());
+			if (!typname) {
+				for (size_t m = 0; m < mtypes.size(); m++) H5Tclose(mtypes[m]);
+				H5Tclose(native);
+				cleanup();
+				STHROW("Member "<<mnames.back()<<" of data set "<<path<<" is not numeric");
+			}
+			columns.push_back(column{ path + "/" + mnames.back(), typname, recsize });
+			recsize += H5Tget_size(mtypes.back());
+		}
+		H5Tclose(native);
+		memtype = H5Tcreate(H5T_COMPOUND, max<size_t>(recsize, 1));
+		for (int idx = 0; idx < nmembers; idx++) {
+			H5Tinsert(memtype, mnames[idx].c_str(), columns[idx].offset, mtypes[idx]);
+			H5Tclose(mtypes[idx]);
+		}
+	}
+
+	~h5_export_source() {
+		cleanup();
+	}
+
+	void read(size_t row, size_t nrows, char *out) {
+		herr_t status;
+		if (shape.empty()) {
+			status = H5Dread(dset, memtype, H5S_ALL, H5S_ALL, H5P_DEFAULT, out);
+		} else {
+			vector<hsize_t> start(shape.size(), 0), count(shape.begin(), shape.end());
+			start[0] = row;
+			count[0] = nrows;
+			H5Sselect_hyperslab(fspace, H5S_SELECT_SET, &start[0], NULL, &count[0], NULL);
+			hsize_t nread = nrows * rowsize();
+			hid_t mspace = H5Screate_simple(1, &nread, NULL);
+			status = H5Dread(dset, memtype, mspace, fspace, H5P_DEFAULT, out);
+			H5Sclose(mspace);
+		}
+		if (status < 0) STHROW("Error reading rows "<<row<<" to "<<row+nrows-1<<" of data set "<<path);
+		PERF_COUNT(bytes, nrows*rowsize()*recsize);
+	}
+};
+
+SWList H5pp::writecolumns(const char *fname, const SWList& datasets, const string& format) {
+	export_check_format(format);
+	perf_scope scope(perf);
+	vector< unique_ptr<export_source> > sources;
+	for (size_t i = 0; i < datasets.size(); i++) {
+		sources.push_back(unique_ptr<export_source>(new h5_export_source(file, datasets.getString(i).c_str())));
+	}
+	return export_columns(sources, fname, format);
+}
+
+H5writer::H5writer(const char *fname, const string& mode) : file(-1), nthreads(0) {
+	if (mode == "create") {
+		file = H5Fcreate(fname, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+	} else if (mode == "append") {
+		file = H5Fopen(fname, H5F_ACC_RDWR, H5P_DEFAULT);
+	} else {
+		STHROW("Unknown mode "<<mode<<", must be create or append");
+	}
+	if (file < 0) STHROW("Can't open "<<fname<<" for writing");
+}
+
+H5writer::~H5writer() { close(); }
+
+void H5writer::close() {
+	if (file >= 0) {
+		H5Fclose(file);
+		file = -1;
+	}
+}
+
+void H5writer::threads(size_t n) {
+	nthreads = n;
+}
+
+// creates missing parent groups of new objects
+static hid_t writer_lcpl() {
+	hid_t lcpl = H5Pcreate(H5P_LINK_CREATE);
+	H5Pset_create_intermediate_group(lcpl, 1);
+	return lcpl;
+}
+
+void H5writer::group(const char *path) {
+	if (file < 0) STHROW("File is closed");
+	hid_t grp;
+	H5E_BEGIN_TRY {
+		grp = H5Gopen(file, path, H5P_DEFAULT);
+	} H5E_END_TRY;
+	if (grp < 0) {
+		hid_t lcpl = writer_lcpl();
+		grp = H5Gcreate(file, path, lcpl, H5P_DEFAULT, H5P_DEFAULT);
+		H5Pclose(lcpl);
+	}
+	if (grp < 0) STHROW("Can't create group "<<path);
+	H5Gclose(grp);
+}
+
+// native type of a packed array, the inverse of h5_typename
+static hid_t h5_nativetype(const string& dtype) {
+	if (dtype == "int8") return H5T_NATIVE_INT8;
+	if (dtype == "uint8") return H5T_NATIVE_UINT8;
+	if (dtype == "int16") return H5T_NATIVE_INT16;
+	if (dtype == "uint16") return H5T_NATIVE_UINT16;
+	if (dtype == "int32") return H5T_NATIVE_INT32;
+	if (dtype == "uint32") return H5T_NATIVE_UINT32;
+	if (dtype == "int64") return H5T_NATIVE_INT64;
+	if (dtype == "uint64") return H5T_NATIVE_UINT64;
+	if (dtype == "float32") return H5T_NATIVE_FLOAT;
+	if (dtype == "float64") return H5T_NATIVE_DOUBLE;
+	STHROW("Unknown data type "<<dtype<<", must be one of int8, uint8, int16, uint16, int32, uint32, int64, uint64, float32 or float64");
+}
 
-static void eval_h5_dspace(hid_t dspace, my_dspaceinfo& dinfo) {
-	dinfo.rank = H5Sget_simple_extent_ndims(dspace);
-	vector<hsize_t> extents(dinfo.rank);
-	H5Sget_simple_extent_dims(dspace, &extents[0], NULL);
-	dinfo.extents.swap(extents); 
+// attaches an attribute, replacing an existing one of the same name
+static void writer_attribute(hid_t file, const char *path, const string& name, hid_t dtype, hid_t dspace, const void *buf) {
+	hid_t obj = H5Oopen(file, path, H5P_DEFAULT);
+	if (obj < 0) STHROW("Can't open object "<<path);
+	if (H5Aexists(obj, name.c_str()) > 0) H5Adelete(obj, name.c_str());
+	hid_t attr = H5Acreate(obj, name.c_str(), dtype, dspace, H5P_DEFAULT, H5P_DEFAULT);
+	herr_t status = attr < 0 ? -1 : H5Awrite(attr, dtype, buf);
+	if (attr >= 0) H5Aclose(attr);
+	H5Oclose(obj);
+	if (status < 0) STHROW("Can't write attribute "<<name<<" of "<<path);
+}
 
-    dinfo.nelements = (dinfo.rank > 0)?1:0;
-	for (int ind = 0; ind < dinfo.rank; ind++) {
-		dinfo.nelements *= dinfo.extents[ind];
+void H5writer::attribute(const char *path, const string& name, const string& value) {
+	if (file < 0) STHROW("File is closed");
+	// fixed length, like the strings written by the scan software
+	hid_t dtype = H5Tcopy(H5T_C_S1);
+	H5Tset_size(dtype, value.empty() ? 1 : value.size());
+	H5Tset_cset(dtype, H5T_CSET_UTF8);
+	hid_t dspace = H5Screate(H5S_SCALAR);
+	try {
+		writer_attribute(file, path, name, dtype, dspace, value.empty() ? "" : value.data());
+	} catch (...) {
+		H5Sclose(dspace);
+		H5Tclose(dtype);
+		throw;
 	}
+	H5Sclose(dspace);
+	H5Tclose(dtype);
 }
 
-struct my_typeinfo {
-	bool isatomic;
-	size_t nmembers;
-	size_t elsize;
-	hid_t native_dtype;
-};
-
-template <h5_api API>
-SWList eval_h5_dtype(my_typeinfo& typeinfo) {
-	SWList description;
-	typeinfo.isatomic=false;
-	typeinfo.nmembers=0;
-	typeinfo.elsize = H5Tget_size(typeinfo.native_dtype);
-	switch (H5Tget_class(typeinfo.native_dtype)) {
-		case H5T_INTEGER : { 
-			if (API==h5d_api) description.push_back("integer");
-			typeinfo.isatomic=true;
-			typeinfo.nmembers = 1;
-			break;
+template <typename T>
+static void writer_pack(const SWList& values, vector<char>& buf) {
+	buf.resize(values.size()*sizeof(T));
+	for (size_t i = 0; i < values.size(); i++) {
+		T v;
+		long l;
+		if (!numeric_limits<T>::is_integer) {
+			v = static_cast<T>(values.getDouble(i));
+		} else if (values.getLong(i, l)) {
+			v = static_cast<T>(l);
+		} else {
+			STHROW("Expected integer, got \""<<values.getString(i)<<"\"");
 		}
-		case H5T_FLOAT: {
-			if (API==h5d_api) description.push_back("float");
-			typeinfo.isatomic=true;
-			typeinfo.nmembers = 1;
-			break;
+		memcpy(&buf[i*sizeof(T)], &v, sizeof(T));
+	}
+}
+
+void H5writer::attribute_numeric(const char *path, const string& name, const string& dtype, const SWList& values) {
+	if (file < 0) STHROW("File is closed");
+	hid_t native = h5_nativetype(dtype);
+	vector<char> buf;
+	if (dtype == "int8") writer_pack<int8_t>(values, buf);
+	else if (dtype == "uint8") writer_pack<uint8_t>(values, buf);
+	else if (dtype == "int16") writer_pack<int16_t>(values, buf);
+	else if (dtype == "uint16") writer_pack<uint16_t>(values, buf);
+	else if (dtype == "int32") writer_pack<int32_t>(values, buf);
+	else if (dtype == "uint32") writer_pack<uint32_t>(values, buf);
+	else if (dtype == "int64") writer_pack<int64_t>(values, buf);
+	else if (dtype == "uint64") writer_pack<uint64_t>(values, buf);
+	else if (dtype == "float32") writer_pack<float>(values, buf);
+	else writer_pack<double>(values, buf);
+	hsize_t n = values.size();
+	hid_t dspace = n == 1 ? H5Screate(H5S_SCALAR) : H5Screate_simple(1, &n, NULL);
+	try {
+		writer_attribute(file, path, name, native, dspace, buf.empty() ? NULL : &buf[0]);
+	} catch (...) {
+		H5Sclose(dspace);
+		throw;
+	}
+	H5Sclose(dspace);
+}
+
+// chunk i of the data in row major order of the chunk grid,
+// padded with zeros at the edges as required for direct chunk writes
+static void writer_gather(const char *data, const vector<hsize_t>& dims, const vector<hsize_t>& chunk, const vector<hsize_t>& grid, size_t elsize, size_t i, vector<hsize_t>& offset, vector<char>& raw) {
+	size_t rank = dims.size();
+	for (size_t k = rank; k-- > 0; ) {
+		offset[k] = (i % grid[k]) * chunk[k];
+		i /= grid[k];
+	}
+	size_t chunkelems = 1;
+	for (size_t k = 0; k < rank; k++) chunkelems *= chunk[k];
+	raw.assign(chunkelems*elsize, 0);
+
+	// copy the rows along the last dimension, which are contiguous in both buffers
+	size_t rowlen = min(chunk[rank-1], dims[rank-1] - offset[rank-1]) * elsize;
+	vector<hsize_t> pos(rank, 0); // position in the chunk, last dimension stays 0
+	while (true) {
+		size_t src = 0, dst = 0;
+		for (size_t k = 0; k < rank; k++) {
+			src = src * dims[k] + offset[k] + pos[k];
+			dst = dst * chunk[k] + pos[k];
 		}
-		case H5T_STRING: {
-			if (API==h5d_api) description.push_back("string");
-			typeinfo.isatomic=true;
-			typeinfo.nmembers = 1;
-			// for pure strings, the size returned does not include the null terminator
-			typeinfo.elsize++;
-			break;
+		memcpy(&raw[dst*elsize], data + src*elsize, rowlen);
+		// next row, skipping the padding beyond the data
+		size_t k = rank - 1;
+		while (k-- > 0) {
+			if (++pos[k] < chunk[k] && offset[k] + pos[k] < dims[k]) break;
+			pos[k] = 0;
 		}
-		case H5T_COMPOUND: {
-			typeinfo.isatomic=false;
-			typeinfo.nmembers = H5Tget_nmembers(typeinfo.native_dtype);
-			if (API==h5d_api) {
-				// create list of identifiers
-				for (size_t idx=0; idx<typeinfo.nmembers; idx++) {
-					char * name = H5Tget_member_name(typeinfo.native_dtype, idx);
-					description.push_back(name);
-					free(name);
-				}
+		if (k == size_t(-1)) break;
+	}
+}
+
+// The chunks are gathered and compressed by a pool of threads and written
+// in order by the calling thread, which is the only one calling HDF5.
+// At most a window of a few chunks per thread is held in memory
+static void writer_chunks(hid_t dset, const char *path, const char *data, const vector<hsize_t>& dims, const vector<hsize_t>& chunk, size_t elsize, int level, size_t nthreads) {
+	size_t rank = dims.size();
+	vector<hsize_t> grid(rank);
+	size_t nchunks = 1;
+	for (size_t k = 0; k < rank; k++) {
+		grid[k] = (dims[k] + chunk[k] - 1) / chunk[k];
+		nchunks *= grid[k];
+	}
+	if (nchunks == 0) return;
+	nthreads = min(nthreads, nchunks);
+
+	struct slot {
+		vector<char> buf;
+		size_t size;
+		bool ready;
+	};
+	size_t window = 4*nthreads;
+	vector<slot> slots(window);
+	for (size_t s = 0; s < window; s++) slots[s].ready = false;
+	mutex lock;
+	condition_variable cond;
+	size_t next = 0, written = 0;
+	bool failed = false;
+
+	auto worker = [&]() {
+		vector<char> raw;
+		vector<hsize_t> offset(rank);
+		while (true) {
+			size_t i;
+			{
+				unique_lock<mutex> guard(lock);
+				cond.wait(guard, [&]() { return failed || next >= nchunks || next < written + window; });
+				if (failed || next >= nchunks) return;
+				i = next++;
 			}
-			break;
+			writer_gather(data, dims, chunk, grid, elsize, i, offset, raw);
+			slot& s = slots[i % window];
+			bool ok = true;
+			if (level > 0) {
+				uLongf len = compressBound(raw.size());
+				s.buf.resize(len);
+				ok = compress2(reinterpret_cast<Bytef*>(&s.buf[0]), &len, reinterpret_cast<const Bytef*>(&raw[0]), raw.size(), level) == Z_OK;
+				s.size = len;
+			} else {
+				s.buf.swap(raw);
+				s.size = s.buf.size();
+			}
+			unique_lock<mutex> guard(lock);
+			if (!ok) failed = true;
+			s.ready = true;
+			cond.notify_all();
 		}
-		default: {
+	};
+
+	vector<thread> pool;
+	for (size_t t = 0; t < nthreads; t++) pool.push_back(thread(worker));
+
+	vector<hsize_t> offset(rank);
+	bool writeerror = false;
+	for (size_t i = 0; i < nchunks; i++) {
+		slot& s = slots[i % window];
+		{
+			unique_lock<mutex> guard(lock);
+			cond.wait(guard, [&]() { return failed || s.ready; });
+			if (failed) break;
 		}
+		size_t c = i;
+		for (size_t k = rank; k-- > 0; ) {
+			offset[k] = (c % grid[k]) * chunk[k];
+			c /= grid[k];
+		}
+		writeerror = H5Dwrite_chunk(dset, H5P_DEFAULT, 0, &offset[0], s.size, &s.buf[0]) < 0;
+		unique_lock<mutex> guard(lock);
+		if (writeerror) failed = true;
+		s.ready = false;
+		written++;
+		cond.notify_all();
+		if (writeerror) break;
+	}
+	bool compresserror;
+	{
+		unique_lock<mutex> guard(lock);
+		compresserror = failed && !writeerror;
+		failed = true; // stops the workers
+		cond.notify_all();
 	}
+	for (size_t t = 0; t < pool.size(); t++) pool[t].join();
 
-	
-	return description;
+	if (writeerror) STHROW("Can't write chunk of data set "<<path);
+	if (compresserror) STHROW("Can't compress chunk of data set "<<path);
 }
 
-template <h5_api API>
-static SWObject importdata(hid_t resource_id, my_typeinfo typeinfo, my_dspaceinfo dinfo) {
-	size_t memsize = typeinfo.elsize*dinfo.nelements;
-	vector<char> bufferspace(memsize);
-	char * buf = &bufferspace[0];
-	if (API==h5d_api) {
-		H5Dread(resource_id, typeinfo.native_dtype, H5S_ALL, H5S_ALL, H5P_DEFAULT, buf);
-	} else {
-		// h5a_api
-		H5Aread(resource_id, typeinfo.native_dtype, buf);
+void H5writer::dataset(const char *path, const string& dtype, const SWList& shape, const SWBytes& data, const SWList& chunks, int level) {
+	if (file < 0) STHROW("File is closed");
+	if (level < 0 || level > 9) STHROW("Compression level "<<level<<" out of range, must be 0..9");
+	hid_t native = h5_nativetype(dtype);
+	size_t elsize = H5Tget_size(native);
+
+	size_t rank = shape.size();
+	vector<hsize_t> dims(rank);
+	size_t nelements = 1;
+	for (size_t k = 0; k < rank; k++) {
+		long d;
+		if (!shape.getLong(k, d) || d < 0) STHROW("Invalid dimension \""<<shape.getString(k)<<"\" in shape");
+		dims[k] = d;
+		nelements *= d;
+	}
+	if (nelements*elsize != data.size) {
+		STHROW("Data of "<<data.size<<" bytes doesn't match shape and type "<<dtype<<", expected "<<nelements*elsize<<" bytes");
 	}
 
-	// compute offsets and data types as constants
-	vector<ssize_t> eloffsets(typeinfo.nmembers);
-	vector<my_dtype> eltypes(typeinfo.nmembers);
-	if (typeinfo.isatomic) {
-		// only one element
-		eloffsets[0]=0;
-		eltypes[0]=h5t_to_my(typeinfo.native_dtype);
-	} else {
-		// multiple elements
-		for (size_t ind=0; ind<typeinfo.nmembers; ind++) {
-			eloffsets[ind]=H5Tget_member_offset(typeinfo.native_dtype, ind);
-			hid_t mtype = H5Tget_member_type(typeinfo.native_dtype, ind);
-			eltypes[ind] = h5t_to_my(mtype);
-			H5Tclose(mtype);
+	hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+	vector<hsize_t> chunk(rank);
+	if (rank > 0) {
+		if (chunks.size() != 0 && chunks.size() != rank) {
+			H5Pclose(dcpl);
+			STHROW("Chunk shape has "<<chunks.size()<<" dimensions, data set has "<<rank);
 		}
+		// chunks of about 1 MiB, complete in the trailing dimensions as far as possible
+		hsize_t left = max<size_t>(1, (1 << 20) / elsize);
+		for (size_t k = rank; k-- > 0; ) {
+			hsize_t d = max<hsize_t>(dims[k], 1);
+			long c;
+			if (chunks.size() == 0) {
+				chunk[k] = min(d, left);
+				left = max<hsize_t>(1, left / chunk[k]);
+			} else if (chunks.getLong(k, c) && c > 0) {
+				chunk[k] = min(d, hsize_t(c));
+			} else {
+				H5Pclose(dcpl);
+				STHROW("Invalid chunk dimension \""<<chunks.getString(k)<<"\"");
+			}
+		}
+		H5Pset_chunk(dcpl, rank, &chunk[0]);
+		if (level > 0) H5Pset_deflate(dcpl, level);
 	}
-	// big conversion switch loop - puh
-
-	SWList data;
-	SWObject sobject;
 
-#define DATACONV(MY_TYPE, CTYPE, SWTYPE) \
-		case MY_TYPE: {\
-			if (API==h5a_api && dinfo.nelements==1) \
-			sobject.MakeBasic(static_cast<SWTYPE>(*(reinterpret_cast<CTYPE*>(dbuf))));\
-			else \
-			data.push_back(static_cast<SWTYPE>(*(reinterpret_cast<CTYPE*>(dbuf))));\
-			break;\
+	hid_t dspace = rank > 0 ? H5Screate_simple(rank, &dims[0], NULL) : H5Screate(H5S_SCALAR);
+	hid_t lcpl = writer_lcpl();
+	hid_t dset = H5Dcreate(file, path, native, dspace, lcpl, dcpl, H5P_DEFAULT);
+	H5Pclose(lcpl);
+	H5Sclose(dspace);
+	H5Pclose(dcpl);
+	if (dset < 0) STHROW("Can't create data set "<<path);
+
+	try {
+		if (rank == 0) {
+			// scalars can't be chunked
+			if (H5Dwrite(dset, native, H5S_ALL, H5S_ALL, H5P_DEFAULT, data.data) < 0) STHROW("Can't write data set "<<path);
+		} else {
+			size_t n = nthreads ? nthreads : max(1u, thread::hardware_concurrency());
+			writer_chunks(dset, path, static_cast<const char*>(data.data), dims, chunk, elsize, level, n);
 		}
+	} catch (...) {
+		H5Dclose(dset);
+		throw;
+	}
+	H5Dclose(dset);
+}
+#endif
+
+void Resampler::setgrid(const SWList& values) {
+	vector<double> g(values.size());
+	for (size_t i = 0; i < g.size(); i++) g[i] = values.getDouble(i);
+	grid.swap(g);
+}
+
+void Resampler::setrange(double start, double step, size_t count) {
+	grid.resize(count);
+	for (size_t i = 0; i < count; i++) grid[i] = start + i*step;
+}
+
+void Resampler::clear() {
+	xs.clear();
+	ys.clear();
+}
+
+void Resampler::addchannel(vector<double>& x, vector<double>& y) {
+	// drop points without position, sort by x and
+	// average the values at identical positions
+	vector<size_t> order;
+	order.reserve(x.size());
+	for (size_t i = 0; i < x.size(); i++) {
+		if (x[i] == x[i]) order.push_back(i);
+	}
+	
+	bool ascending = true, descending = true;
+	for (size_t i = 1; i < order.size(); i++) {
+		if (x[order[i-1]] > x[order[i]]) ascending = false;
+		if (x[order[i-1]] < x[order[i]]) descending = false;
+	}
+	if (descending && !ascending) {
+		reverse(order.begin(), order.end());
+	} else if (!ascending) {
+		stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return x[a] < x[b]; });
+	}
 
+	vector<double> sx, sy;
+	size_t i = 0;
+	while (i < order.size()) {
+		double xval = x[order[i]];
+		double sum = 0.0;
+		size_t count = 0;
+		size_t j = i;
+		while (j < order.size() && x[order[j]] == xval) {
+			double v = y[order[j]];
+			if (v == v) { sum += v; count++; }
+			j++;
+		}
+		sx.push_back(xval);
+		sy.push_back(count ? sum / count : numeric_limits<double>::quiet_NaN());
+		i = j;
+	}
 	
-	for (char * el = buf; el < buf+memsize; el +=typeinfo.elsize) {
-		//iterate over all elements in this dataset
-		for (size_t ind=0; ind<typeinfo.nmembers; ind++) {
-			char * dbuf = el + eloffsets[ind];
-			switch (eltypes[ind]) {
-				// decide about datatype
-				DATACONV(MY_NATIVE_CHAR, char, int)
-				DATACONV(MY_NATIVE_SHORT,short, int)
-				DATACONV(MY_NATIVE_INT, int, int)
-				DATACONV(MY_NATIVE_LONG,long, long)
-				DATACONV(MY_NATIVE_LLONG,long long, long long)
-				DATACONV(MY_NATIVE_UCHAR,unsigned char, int)
-				DATACONV(MY_NATIVE_USHORT,unsigned short, int)
-				DATACONV(MY_NATIVE_UINT, unsigned int, long)
-				DATACONV(MY_NATIVE_ULONG,unsigned long, long long)
-				DATACONV(MY_NATIVE_ULLONG,unsigned long long, unsigned long long)
-				DATACONV(MY_NATIVE_FLOAT,float, float)
-				DATACONV(MY_NATIVE_DOUBLE,double, double)
-				DATACONV(MY_NATIVE_LDOUBLE,long double, double)
-				case MY_NATIVE_C_S1: {
-					//cout<<"String: "<<dbuf<<endl;
-					if (API==h5a_api && dinfo.nelements==1)
-						sobject.MakeBasic(dbuf);
-					else 
-						data.push_back(dbuf);
-					break;
-				} 
+	xs.push_back(vector<double>());
+	ys.push_back(vector<double>());
+	xs.back().swap(sx);
+	ys.back().swap(sy);
+}
 
-				default: {
-					data.push_back("???");
-				}
+static void read_column(column_reader& reader, vector<double>& buf) {
+	buf.resize(reader.size());
+	if (!buf.empty()) reader.read(0, buf.size(), &buf[0]);
+}
+
+void Resampler::add_hdf4(HDFpp *file, size_t axis, size_t values) {
+	if (!file) STHROW("No HDF4 file given");
+	size_t ndatasets = file->get_num_datasets();
+	if (axis >= ndatasets || values >= ndatasets) STHROW("Only "<<ndatasets<<" data sets available, requested nr "<<max(axis, values));
+	file->ensure_sdstable();
+
+	h4_column_reader xreader(file->hdf_id, file->sdstable[axis], axis);
+	h4_column_reader yreader(file->hdf_id, file->sdstable[values], values);
+	if (xreader.size() != yreader.size()) {
+		STHROW("Axis and values have different lengths "<<xreader.size()<<" and "<<yreader.size());
+	}
+	vector<double> x, y;
+	read_column(xreader, x);
+	read_column(yreader, y);
+	addchannel(x, y);
+}
 
+SWDict Resampler::run(const string& method) {
+	bool linear;
+	if (method == "linear") linear = true;
+	else if (method == "nearest") linear = false;
+	else STHROW("Unknown interpolation "<<method<<", must be linear or nearest");
+
+	const double nan = numeric_limits<double>::quiet_NaN();
+	size_t n = grid.size();
+	bool gridsorted = is_sorted(grid.begin(), grid.end());
+	
+	SWList data;
+	vector<double> ya(n), yb(n), w(n), out(n);
+	for (size_t c = 0; c < xs.size(); c++) {
+		const vector<double> &x = xs[c];
+		const vector<double> &y = ys[c];
+		
+		// find the interval of every grid point. For a sorted grid, 
+		// this is a merge of both sorted arrays, else a binary search
+		size_t k = 0;
+		for (size_t i = 0; i < n; i++) {
+			double g = grid[i];
+			if (x.empty() || !(g >= x.front() && g <= x.back())) {
+				// outside of the channel, or NaN
+				ya[i] = yb[i] = nan;
+				w[i] = 0.0;
+				continue;
 			}
+			
+			if (gridsorted) {
+				while (k + 1 < x.size() && x[k+1] <= g) k++;
+			} else {
+				k = upper_bound(x.begin(), x.end(), g) - x.begin() - 1;
+			}
+			
+			if (k + 1 >= x.size() || g == x[k]) {
+				// last point or exact hit, a NaN in the next sample
+				// must not leak into 0*(yb-ya)
+				ya[i] = yb[i] = y[k];
+				w[i] = 0.0;
+			} else {
+				ya[i] = y[k];
+				yb[i] = y[k+1];
+				w[i] = (g - x[k]) / (x[k+1] - x[k]);
+			}
+		}
+
+		if (linear) {
+			kernel_lerp(n ? &ya[0] : NULL, n ? &yb[0] : NULL, n ? &w[0] : NULL, n ? &out[0] : NULL, n);
+		} else {
+			for (size_t i = 0; i < n; i++) out[i] = w[i] < 0.5 ? ya[i] : yb[i];
 		}
+		data.push_back(make_packed("float64", vector<long>(1, n), out));
 	}
 
-	if (API==h5a_api && dinfo.nelements==1) return sobject;
-	else return data;
+	SWDict result;
+	result.insert("grid", make_packed("float64", vector<long>(1, n), grid));
+	result.insert("data", data);
+	return result;
 }
 
-
-void readdataset5_internal(hid_t loc_id, const char *name, SWDict& datasetdata) {
-	datasetdata.insert("type", "DATASET");
-	datasetdata.insert("name", name);
+#ifdef HAVE_HDF5
+void Resampler::add_h5(H5pp *file, const char *axis, const char *values) {
+	if (!file) STHROW("No HDF5 file given");
+	vector<double> x, y;
 	
-	// open data set
-	hid_t dset = H5Dopen(loc_id, name, H5P_DEFAULT);
-	// get data space & type
-	hid_t dspace = H5Dget_space(dset);
-	hid_t dtype  = H5Dget_type(dset);
+	// the BESSY scans store axes and channels as {PosCounter, value}
+	// in separate data sets, which are joined on the PosCounter
+	hid_t dset = H5Dopen(file->file, axis, H5P_DEFAULT);
+	if (dset < 0) STHROW("Can't open data set "<<axis);
+	hid_t dtype = H5Dget_type(dset);
+	bool haspos = h5_has_member(dtype, "PosCounter");
+	H5Tclose(dtype);
+	H5Dclose(dset);
 
-	SWDict attrs;
-	readattr5_internal(dset, attrs);
-	datasetdata.insert("attrs", attrs);
+	if (haspos) {
+		vector<scan_column> cols(2);
+		read_scan_column(file->file, axis, dup_mean, cols[0]);
+		read_scan_column(file->file, values, dup_mean, cols[1]);
+		vector<long long> keys;
+		vector< vector<double> > table;
+		join_scan_columns(cols, false, keys, table);
+		x.swap(table[0]);
+		y.swap(table[1]);
+	} else {
+		h5_column_reader xreader(file->file, axis, "");
+		h5_column_reader yreader(file->file, values, "");
+		if (xreader.size() != yreader.size()) {
+			STHROW("Axis and values have different lengths "<<xreader.size()<<" and "<<yreader.size());
+		}
+		read_column(xreader, x);
+		read_column(yreader, y);
+	}
+	addchannel(x, y);
+}
+#endif
 
-	my_dspaceinfo dinfo;
-	eval_h5_dspace(dspace, dinfo);
+// running statistics per element of a stack of data sets
+struct stack_accumulator {
+	vector<double> count, mean, m2, sum, mn, mx;
+	
+	void resize(size_t n) {
+		count.resize(n, 0.0);
+		mean.resize(n, 0.0);
+		m2.resize(n, 0.0);
+		sum.resize(n, 0.0);
+		mn.resize(n, numeric_limits<double>::infinity());
+		mx.resize(n, -numeric_limits<double>::infinity());
+	}
 
-	SWList dspace_list;
-	dspace_list.push_back(dinfo.extents);
-	datasetdata.insert("dspace", dspace_list);
-	datasetdata.insert("ndata", dinfo.nelements);
+	size_t size() const {
+		return count.size();
+	}
 
+	kernel_accumulator at(size_t offset) {
+		kernel_accumulator acc = { &count[offset], &mean[offset], &m2[offset], &sum[offset], &mn[offset], &mx[offset] };
+		return acc;
+	}
 
-	my_typeinfo tinfo;
-	tinfo.native_dtype = H5Tget_native_type(dtype, H5T_DIR_ASCEND);
-	SWList dtype_list = eval_h5_dtype<h5d_api>(tinfo);
-	datasetdata.insert("dtype", dtype_list);
+	void add(const double *v, size_t offset, size_t n) {
+		if (n > 0) kernel_accumulate(v, n, at(offset));
+	}
+
+	// move the elements to new positions after new keys were merged in
+	void remap(const vector<size_t>& newpos, size_t n) {
+		stack_accumulator result;
+		result.resize(n);
+		for (size_t i = 0; i < newpos.size(); i++) {
+			size_t j = newpos[i];
+			result.count[j] = count[i];
+			result.mean[j] = mean[i];
+			result.m2[j] = m2[i];
+			result.sum[j] = sum[i];
+			result.mn[j] = mn[i];
+			result.mx[j] = mx[i];
+		}
+		swap(result);
+	}
 
-	datasetdata.insert("data", importdata<h5d_api>(dset, tinfo, dinfo));
+	void swap(stack_accumulator& other) {
+		count.swap(other.count);
+		mean.swap(other.mean);
+		m2.swap(other.m2);
+		sum.swap(other.sum);
+		mn.swap(other.mn);
+		mx.swap(other.mx);
+	}
+};
 
-	// close type&space
-	H5Tclose(tinfo.native_dtype);
-	H5Tclose(dtype);
-	H5Sclose(dspace);
-	// close data set
-	H5Dclose(dset);
+static bool is_hdf5(const string& fname) {
+#ifdef HAVE_HDF5
+	return H5Fis_hdf5(fname.c_str()) > 0;
+#else
+	return false;
+#endif
 }
 
-void readdatatype5_internal(hid_t loc_id, const char *name, SWDict& datatypedata) {	
-	SWDict attrs;
-	/* readattr5_internal(loc_id, attrs); */
+static void aggregate_index(column_reader& reader, const string& fname, stack_accumulator& acc, bool first) {
+	// element by element, all data sets must have the same length
+	size_t n = reader.size();
+	if (first) {
+		acc.resize(n);
+	} else if (n != acc.size()) {
+		STHROW("Data set in "<<fname<<" has "<<n<<" values, expected "<<acc.size());
+	}
 
-	datatypedata.insert("type", "DATATYPE");
-	datatypedata.insert("name", name);
-	datatypedata.insert("attrs", attrs);
+	stream_blocks(reader, NULL, 0, n, [&](size_t start, const double *, const double *y, size_t count) {
+		acc.add(y, start, count);
+	});
+}
 
-	// now read the data
-	SWList data;
-	datatypedata.insert("data", data);
- }
+#ifdef HAVE_HDF5
+static void aggregate_poscounter(scan_column& col, stack_accumulator& acc, vector<long long>& keys) {
+	// merge the new positions into the sorted keys
+	vector<long long> newkeys;
+	newkeys.reserve(keys.size() + col.keys.size());
+	set_union(keys.begin(), keys.end(), col.keys.begin(), col.keys.end(), back_inserter(newkeys));
+	
+	if (newkeys.size() != keys.size()) {
+		vector<size_t> newpos(keys.size());
+		size_t j = 0;
+		for (size_t i = 0; i < keys.size(); i++) {
+			while (newkeys[j] != keys[i]) j++;
+			newpos[i] = j;
+		}
+		acc.remap(newpos, newkeys.size());
+		keys.swap(newkeys);
+	}
 
-herr_t dumpattrib_callback (hid_t loc_id, const char *attr_name, const H5A_info_t *info, void *attrdictptr);
+	// values of this file on the common positions, NaN elsewhere
+	vector<double> values(keys.size(), numeric_limits<double>::quiet_NaN());
+	size_t j = 0;
+	for (size_t i = 0; i < col.keys.size(); i++) {
+		while (keys[j] != col.keys[i]) j++;
+		values[j] = col.values[i];
+	}
+	acc.add(values.empty() ? NULL : &values[0], 0, values.size());
+}
+#endif
 
+SWDict aggregate(const SWList& files, const string& dataset, const string& stat, const string& align) {
+	if (stat != "sum" && stat != "mean" && stat != "variance" && stat != "min" && stat != "max" && stat != "count") {
+		STHROW("Unknown statistic "<<stat<<", must be sum, mean, variance, min, max or count");
+	}
+	bool bypos;
+	if (align == "index") bypos = false;
+	else if (align == "poscounter") bypos = true;
+	else STHROW("Unknown alignment "<<align<<", must be index or poscounter");
+
+	// only the accumulator and the data set of one file are held in memory
+	stack_accumulator acc;
+	vector<long long> keys;
+	size_t nfiles = files.size();
+	for (size_t f = 0; f < nfiles; f++) {
+		string fname = files.getString(f);
+		if (is_hdf5(fname)) {
+#ifdef HAVE_HDF5
+			H5pp h(fname.c_str());
+			if (bypos) {
+				scan_column col;
+				read_scan_column(h.file, dataset, dup_mean, col);
+				aggregate_poscounter(col, acc, keys);
+			} else {
+				h5_column_reader reader(h.file, dataset.c_str(), "");
+				aggregate_index(reader, fname, acc, f == 0);
+			}
+#endif
+		} else {
+			if (bypos) STHROW("HDF4 file "<<fname<<" has no PosCounter, can't align");
+			HDFpp h(fname.c_str());
+			size_t index = h.getindex(dataset);
+			h4_column_reader reader(h.hdf_id, h.sdstable[index], index);
+			aggregate_index(reader, fname, acc, f == 0);
+		}
+	}
 
-void readattr5_internal(hid_t resource_id, SWDict& attrs) {
-	// start iteration over attributes and insert into dict
-	H5Aiterate(resource_id, H5_INDEX_CRT_ORDER, H5_ITER_NATIVE, NULL, dumpattrib_callback, &attrs);
+	size_t n = acc.size();
+	const double nan = numeric_limits<double>::quiet_NaN();
+	vector<double> result(n);
+	if (stat == "count") {
+		result = acc.count;
+	} else if (stat == "sum") {
+		result = acc.sum;
+	} else {
+		const vector<double> &src = (stat == "mean") ? acc.mean : (stat == "min") ? acc.mn : (stat == "max") ? acc.mx : acc.m2;
+		double mincount = (stat == "variance") ? 2 : 1;
+		for (size_t i = 0; i < n; i++) {
+			double cnt = acc.count[i];
+			if (cnt < mincount) result[i] = nan;
+			else if (stat == "variance") result[i] = src[i] / (cnt - 1);
+			else result[i] = src[i];
+		}
+	}
+	
+	SWDict packed = make_packed("float64", vector<long>(1, n), result);
+	if (bypos) {
+		packed.insert("PosCounter", make_packed("int64", vector<long>(1, n), keys));
+	}
+	return packed;
 }
 
+struct Cursor::cursor_state {
+	unique_ptr<column_reader> reader;
+	bool concurrent;
+	size_t position;
+	// block read ahead by the worker: [aheadstart, aheadstart+ahead.size())
+	thread worker;
+	vector<double> ahead;
+	size_t aheadstart;
+	string aheaderror;
+
+	void wait() {
+		if (worker.joinable()) worker.join();
+	}
 
-herr_t dumpattrib_callback (hid_t loc_id, const char *attr_name, const H5A_info_t *info, void *attrdictptr) {
-	SWDict & attrs = *(reinterpret_cast<SWDict*>(attrdictptr));
-	hid_t attr_id = H5Aopen(loc_id, attr_name, H5P_DEFAULT);
-	hid_t dtype = H5Aget_type(attr_id);
-	hid_t dspace = H5Aget_space(attr_id);
-	
-	my_dspaceinfo dinfo;
-	eval_h5_dspace(dspace, dinfo);
+	void prefetch(size_t n) {
+		size_t count = min(n, reader->size() - position);
+		if (!concurrent || count == 0) return;
+		ahead.resize(count);
+		aheadstart = position;
+		aheaderror.clear();
+		worker = thread([this, count]() {
+			try {
+				reader->read(aheadstart, count, &ahead[0]);
+			} catch (const exception& e) {
+				aheaderror = e.what();
+			}
+		});
+	}
+};
 
-	my_typeinfo tinfo;
-	tinfo.native_dtype = H5Tget_native_type(dtype, H5T_DIR_ASCEND);
-	eval_h5_dtype<h5a_api>(tinfo);
+Cursor::Cursor(column_reader *reader, bool concurrent) : state(new cursor_state) {
+	state->reader.reset(reader);
+	state->concurrent = concurrent;
+	state->position = 0;
+	state->aheadstart = 0;
+}
 
-	attrs.insert(attr_name, importdata<h5a_api>(attr_id, tinfo, dinfo));
+Cursor::~Cursor() {
+	state->wait();
+	delete state;
+}
 
-	// close type&space
-	H5Tclose(tinfo.native_dtype);
-	H5Tclose(dtype);
-	H5Sclose(dspace);
-	// close data set
-	H5Aclose(attr_id);
+SWList Cursor::next(size_t n) {
+	state->wait();
+	size_t count = min(n, state->reader->size() - state->position);
+	vector<double> block;
+	if (!state->ahead.empty() && state->aheadstart == state->position && state->ahead.size() == count) {
+		block.swap(state->ahead);
+		if (!state->aheaderror.empty()) STHROW(state->aheaderror);
+	} else {
+		block.resize(count);
+		if (count > 0) state->reader->read(state->position, count, &block[0]);
+	}
+	state->ahead.clear();
+	state->position += count;
+	state->prefetch(n);
+	
+	SWList result;
+	for (size_t i = 0; i < block.size(); i++) result.push_back(block[i]);
+	return result;
+}
+
+size_t Cursor::size() {
+	return state->reader->size();
+}
 
+size_t Cursor::position() {
+	return state->position;
+}
 
-	return 0; //Success, continue
+void Cursor::rewind() {
+	state->wait();
+	state->ahead.clear();
+	state->position = 0;
 }
-#endif
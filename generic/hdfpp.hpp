@@ -27,6 +27,9 @@
 #include <string>
 #include <sstream>
 #include <stdexcept>
+#ifndef SWIG
+#include <unordered_map>
+#endif
 #include "SWObject.hpp"
 
 
@@ -36,11 +39,56 @@
 	 throw std::runtime_error(err.str()); }
 
 
+#ifndef SWIG
+// metadata of one HDF4 scientific data set (SDS), as returned by SDgetinfo
+struct sds_meta {
+	std::string name;
+	int rank;
+	std::vector<long> dims;
+	int data_type;
+	int num_attrs;
+	int comp_type;
+};
+
+// performance counters of a file handle, updated while profiling is on
+struct perf_counters {
+	bool enabled;
+	size_t objects;     // groups, data sets and links visited
+	size_t attributes;  // attributes read
+	size_t bytes;       // payload read from the file
+	size_t allocations; // read buffers allocated
+	size_t created;     // interpreter objects created
+	double t_io, t_decode, t_marshal; // seconds
+	perf_counters() : enabled(false) { reset(); }
+	void reset() {
+		objects = attributes = bytes = allocations = created = 0;
+		t_io = t_decode = t_marshal = 0.0;
+	}
+};
+#endif
+
+class Resampler;
+class Cursor;
+#ifndef SWIG
+class column_reader;
+#endif
+
 // reading HDF4 files into nested lists/dicts
 class HDFpp {
     int hdf_id;
     size_t ndatasets;
     size_t nglobal_attrs;
+#ifndef SWIG
+	friend class Resampler;
+	friend SWDict aggregate(const SWList& files, const std::string& dataset, const std::string& stat, const std::string& align);
+	// filled on first use by ensure_sdstable()
+	std::vector<sds_meta> sdstable;
+	std::unordered_map<std::string, size_t> sdsindex;
+	void ensure_sdstable();
+	size_t resolve(const SWList& items, size_t i);
+	perf_counters perf;
+	size_t budget;
+#endif
 public:
     HDFpp(const char *fname);
     ~HDFpp();
@@ -49,10 +97,38 @@ public:
         return ndatasets;
     }
 	std::string getname(size_t index);
-    SWList readdata(size_t index);
+	size_t getindex(const std::string& name);
+	SWDict getinfo(size_t index);
+    SWObject readdata(size_t index);
+	// read a hyperslab, empty lists select everything / unit stride
+	SWObject readslab(size_t index, const SWList& start, const SWList& edge, const SWList& stride = SWList());
+	SWObject readpacked(size_t index, const SWList& start = SWList(), const SWList& edge = SWList(), const SWList& stride = SWList());
+	// min/max envelope or LTTB selection of a 1D data set for plotting
+	SWDict decimate(size_t index, size_t nbuckets, const std::string& mode = "minmax", long first = 0, long last = -1);
+	// count, min, max, sum, mean and variance, ignoring NaN
+	SWDict stats(size_t index);
+	// cursor for reading a 1D data set block by block
+	Cursor *open_dataset(size_t index);
     SWDict readattrs(size_t index);
+	// read several data sets given by name or index in one go
+	SWList readdata_batch(const SWList& items);
+	SWList readattrs_batch(const SWList& items);
 	SWDict readglobalattrs();
 	SWObject dump();
+	// write the dump as a JSON array, or NDJSON with one entry per line, to a file
+	void writejson(const char *fname, const std::string& format = "json");
+	// numeric data sets given by name or index as columns, to an Arrow IPC
+	// stream or to .npy files in the directory fname. Returns the columns or files
+	SWList writecolumns(const char *fname, const SWList& datasets, const std::string& format = "arrow");
+	// switch the performance counters on or off
+	void profile(bool enable);
+	// counters and timings of the read calls, "reset" clears them after returning
+	SWDict perfstats(const std::string& action = "");
+	// payload size and estimated memory of a dump, without reading any data
+	SWDict estimate();
+	// limit for the data read by dump, 0 for unlimited. Data sets which
+	// don't fit are replaced by a placeholder with a preview
+	void memory_budget(size_t maxbytes);
 };
 
 #ifdef HAVE_HDF5
@@ -62,10 +138,152 @@ public:
 #include "hdf5.h"
 class H5pp {
 	hid_t file;
+#ifndef SWIG
+	friend class Resampler;
+	friend SWDict aggregate(const SWList& files, const std::string& dataset, const std::string& stat, const std::string& align);
+	perf_counters perf;
+	size_t budget;
+#endif
 public:
-	H5pp(const char *fname);
+	// driver "blockcache" reads through a block cache with read-ahead, for network file systems
+	H5pp(const char *fname, const std::string& driver = "default");
 	~H5pp();
 	void close();
 	SWObject dump(int maxlevel = 0, const char *root="/");
+	// streaming dump: the command prefixes are called with the path and the dict
+	// of each object as the walk progresses, instead of building the tree.
+	// Groups are passed without their members; break from ongroup skips them,
+	// onleave gets the path and the name after the members.
+	// Empty prefixes are not called, data sets are not read without ondataset
+	void walk(const SWCallback& ongroup, const SWCallback& onleave, const SWCallback& ondataset, const SWCallback& onlink, int maxlevel = 0, const char *root="/");
+	// write the dump as JSON, or NDJSON with one object per line, to a file
+	void writejson(const char *fname, const std::string& format = "json", int maxlevel = 0, const char *root="/");
+	// numeric data sets as columns, compound members split into path/member,
+	// to an Arrow IPC stream or to .npy files in the directory fname.
+	// Returns the columns or files
+	SWList writecolumns(const char *fname, const SWList& datasets, const std::string& format = "arrow");
+	// switch the performance counters on or off
+	void profile(bool enable);
+	// counters, timings and the metadata cache hit rate, "reset" clears them after returning
+	SWDict perfstats(const std::string& action = "");
+	// payload size and estimated memory of a dump, without reading any data
+	SWDict estimate(int maxlevel = 0, const char *root="/");
+	// limit for the data read by dump, 0 for unlimited. Data sets which
+	// don't fit are replaced by a placeholder with a preview
+	void memory_budget(size_t maxbytes);
+	// min/max envelope or LTTB selection of a 1D data set for plotting
+	SWDict decimate(const char *path, size_t nbuckets, const std::string& mode = "minmax", long first = 0, long last = -1, const std::string& member = "");
+	// count, min, max, sum, mean and variance, ignoring NaN
+	SWDict stats(const char *path, const std::string& member = "");
+	// cursor for reading a data set block by block, in storage order
+	Cursor *open_dataset(const char *path, const std::string& member = "");
+	// table of {PosCounter, value} channels joined on the PosCounter
+	SWDict jointable(const char *group, const SWList& datasets, const std::string& duplicates = "first", const std::string& join = "outer");
+	// evaluate an expression like "a/b" over data sets given as dict name -> path
+	SWDict compute(const std::string& expression, const SWList& operands, const std::string& align = "index");
+	// images: frame k of a 2D image or 3D stack, rebinned frame, histogram
+	SWDict readframe(const char *path, long frame = 0);
+	SWDict rebin(const char *path, size_t fy, size_t fx, const std::string& mode = "sum", long frame = 0);
+	SWDict histogram(const char *path, size_t nbins, const SWList& range = SWList(), long frame = -1);
+	// content hashes of data sets, attributes and subtrees, in the structure of dump
+	SWDict fingerprint(int maxlevel = 0, const char *root="/");
+	// paths below root which differ from the other file, with what differs
+	SWDict diff(H5pp *other, const char *root="/");
+	// cached multi-resolution pyramid for zooming: shapes of the levels and tiles of a level
+	SWDict pyramid(const char *path, long frame = 0);
+	SWDict tile(const char *path, size_t level, long y0, long x0, long ny, long nx, long frame = 0);
+};
+
+// writing derived results: groups, attributes and chunked, compressed data sets
+class H5writer {
+	hid_t file;
+#ifndef SWIG
+	size_t nthreads;
+#endif
+public:
+	// mode "create" truncates an existing file, "append" adds to it
+	H5writer(const char *fname, const std::string& mode = "create");
+	~H5writer();
+	void close();
+	// creates the missing groups along the path
+	void group(const char *path);
+	// string attribute, or numeric attribute of dtype (scalar for a single value)
+	// of a group or data set. An existing attribute is replaced
+	void attribute(const char *path, const std::string& name, const std::string& value);
+	void attribute_numeric(const char *path, const std::string& name, const std::string& dtype, const SWList& values);
+	// data set from a packed buffer in native layout, as returned by readframe etc.
+	// Chunks default to about 1 MiB, level 0 disables deflate. The chunks are
+	// compressed in parallel and written directly, without the filter pipeline
+	void dataset(const char *path, const std::string& dtype, const SWList& shape, const SWBytes& data, const SWList& chunks = SWList(), int level = 6);
+	// number of compression threads, 0 for one per core
+	void threads(size_t n);
 };
+
+// memory budget of the pyramid cache, evicted pyramids are spilled to spilldir if given
+void pyramid_cache(size_t maxbytes, const std::string& spilldir = "");
+void pyramid_clear();
+// block size in bytes, number of cached blocks per file and maximum read-ahead
+// in blocks of the blockcache driver, for files opened afterwards; open files
+// keep the settings they were opened with
+void blockcache_config(size_t blocksize, size_t nblocks, size_t readahead = 16);
+// background prefetch of complete HDF5 files into memory, which are then opened
+// from there. Watched directories (Linux only) queue files closed after writing
+void prefetch_watch(const std::string& dir);
+void prefetch_unwatch(const std::string& dir);
+void prefetch_file(const std::string& fname);
+// memory for the prefetched files, largest file (0 for maxbytes) and concurrent reads
+void prefetch_config(size_t maxbytes, size_t maxfile = 0, size_t workers = 1);
+// cached files, bytes, queued files, hits and misses; wait for the queue to drain first
+SWDict prefetch_stats(bool wait = false);
+void prefetch_clear();
+#ifndef SWIG
+// delay added to every read of the blockcache driver, for benchmarks
+void blockcache_latency(double seconds);
+#endif
+#endif
+
+// interpolation of channels, possibly from several files, onto a common grid
+class Resampler {
+#ifndef SWIG
+	std::vector<double> grid;
+	// x and y of every channel, sorted by x with unique x values
+	std::vector< std::vector<double> > xs;
+	std::vector< std::vector<double> > ys;
+	void addchannel(std::vector<double>& x, std::vector<double>& y);
+#endif
+public:
+	Resampler() { }
+	void setgrid(const SWList& values);
+	void setrange(double start, double step, size_t count);
+	void add_hdf4(HDFpp *file, size_t axis, size_t values);
+#ifdef HAVE_HDF5
+	void add_h5(H5pp *file, const char *axis, const char *values);
 #endif
+	void clear();
+	SWDict run(const std::string& method = "linear");
+};
+
+// Iteration over a data set in blocks with bounded memory.
+// The data set stays open between the calls to next.
+// If the HDF library is thread safe, the following block of the same size 
+// is read in the background while the caller processes the current one.
+class Cursor {
+#ifndef SWIG
+	struct cursor_state;
+	cursor_state *state;
+public:
+	// takes ownership of the reader
+	Cursor(column_reader *reader, bool concurrent);
+#endif
+public:
+	~Cursor();
+	// next n values, an empty list at the end
+	SWList next(size_t n);
+	size_t size();
+	size_t position();
+	void rewind();
+};
+
+// statistics over the same data set in many files (HDF5 path or HDF4 SDS name),
+// aligned by index or by PosCounter
+SWDict aggregate(const SWList& files, const std::string& dataset, const std::string& stat = "mean", const std::string& align = "index");
@@ -34,9 +34,16 @@
 %include std_string.i
 %{
 #include "hdfpp.hpp"
+#ifdef SWIGTCL
+#include "hdfppcmd.hpp"
+#endif
 %}
 
 %init {
+#ifdef SWIGTCL
+	SWLazyList_Init(interp);
+	hdfppcmd_init(interp);
+#endif
 }
 
 %exception {
@@ -58,5 +65,8 @@ typedef unsigned long int size_t;
 typedef unsigned int size_t;
 #endif
 
+%newobject HDFpp::open_dataset;
+%newobject H5pp::open_dataset;
+
 %include SWObject.hpp
 %include hdfpp.hpp
@@ -0,0 +1,281 @@
+/*  hdfppcmd.hpp
+*
+*   (C) Copyright 2021 Physikalisch-Technische Bundesanstalt (PTB)
+*   Christian Gollwitzer
+*
+*   This file is part of BessyHDFViewer.
+*
+*   BessyHDFViewer is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   BessyHDFViewer is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with BessyHDFViewer.  If not, see <https://www.gnu.org/licenses/>.
+**
+*/
+
+/** Native dispatch of the frequently called methods of HDFpp and H5pp objects.
+ * Included into the SWIG wrapper for Tcl, as it builds on the SWIG runtime.
+ * After SWIG has created an object command, its command procedure is replaced
+ * by one which reads the object from the clientData and the arguments directly
+ * from objv. Other methods, and calls whose arguments SWIG would reject, are
+ * passed on to SWIG, such that names, results and error messages stay the same.
+ **/
+
+#ifndef HDFPPCMD_HPP
+#define HDFPPCMD_HPP
+
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+// the same conversion of exceptions as %exception in hdfpp.i
+static int hdfppcmd_error(Tcl_Interp *interp) {
+	int code = SWIG_RuntimeError;
+	std::string msg;
+	try {
+		throw;
+	} catch (const std::string &s) {
+		msg = s;
+	} catch (const std::invalid_argument &e) {
+		code = SWIG_ValueError; msg = e.what();
+	} catch (const std::domain_error &e) {
+		code = SWIG_ValueError; msg = e.what();
+	} catch (const std::overflow_error &e) {
+		code = SWIG_OverflowError; msg = e.what();
+	} catch (const std::out_of_range &e) {
+		code = SWIG_IndexError; msg = e.what();
+	} catch (const std::length_error &e) {
+		code = SWIG_IndexError; msg = e.what();
+	} catch (const std::runtime_error &e) {
+		msg = e.what();
+	} catch (const std::exception &e) {
+		code = SWIG_SystemError; msg = e.what();
+	} catch (...) {
+		msg = "Some undefined C++-Error";
+	}
+	SWIG_Tcl_SetErrorMsg(interp, SWIG_Tcl_ErrorType(code), msg.c_str());
+	return TCL_ERROR;
+}
+
+// arguments as SWIG accepts them; false leaves the call to SWIG
+static bool hdfppcmd_index(Tcl_Obj *obj, size_t &value) {
+	Tcl_WideInt w;
+	if (Tcl_GetWideIntFromObj(NULL, obj, &w) != TCL_OK || w < 0) return false;
+	value = static_cast<size_t>(w);
+	return true;
+}
+
+static bool hdfppcmd_int(Tcl_Obj *obj, int &value) {
+	Tcl_WideInt w;
+	if (Tcl_GetWideIntFromObj(NULL, obj, &w) != TCL_OK || w < INT_MIN || w > INT_MAX) return false;
+	value = static_cast<int>(w);
+	return true;
+}
+
+static bool hdfppcmd_long(Tcl_Obj *obj, long &value) {
+	Tcl_WideInt w;
+	if (Tcl_GetWideIntFromObj(NULL, obj, &w) != TCL_OK || w < LONG_MIN || w > LONG_MAX) return false;
+	value = static_cast<long>(w);
+	return true;
+}
+
+static void hdfppcmd_result(Tcl_Interp *interp, const SWObject &result) {
+	Tcl_SetObjResult(interp, result.getObj());
+}
+
+static void hdfppcmd_result(Tcl_Interp *interp, size_t result) {
+	Tcl_SetObjResult(interp, Tcl_NewWideIntObj(static_cast<Tcl_WideInt>(result)));
+}
+
+static void hdfppcmd_result(Tcl_Interp *interp, const std::string &result) {
+	Tcl_SetObjResult(interp, Tcl_NewStringObj(result.data(), result.size()));
+}
+
+// command procedures installed by SWIG for the constructor and the objects of a class
+struct hdfppcmd_class {
+	Tcl_CmdInfo constructor;
+	Tcl_ObjCmdProc *method;
+	Tcl_ObjCmdProc *fast;
+};
+
+// index of the method name in a NULL terminated table, -1 if not there.
+// The index is cached in the method name, such that loops don't compare strings
+static int hdfppcmd_method(Tcl_Obj *name, const char *const *table) {
+	int index;
+	if (Tcl_GetIndexFromObj(NULL, name, table, "method", TCL_EXACT, &index) != TCL_OK) return -1;
+	return index;
+}
+
+static hdfppcmd_class hdfppcmd_hdfpp;
+
+static const char *const hdfppcmd_hdfpp_methods[] = {
+	"get_num_datasets", "getname", "getindex", "getinfo", "readdata",
+	"readattrs", "readglobalattrs", "dump", NULL
+};
+
+// TCL_CONTINUE for calls which are left to SWIG
+static int hdfppcmd_hdfpp_call(HDFpp *h, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+	enum { GETNUM, GETNAME, GETINDEX, GETINFO, READDATA, READATTRS, READGLOBALATTRS, DUMP };
+	int method = hdfppcmd_method(objv[1], hdfppcmd_hdfpp_methods);
+	size_t index;
+	try {
+		switch (method) {
+			case GETNUM:
+				if (objc != 2) break;
+				hdfppcmd_result(interp, h->get_num_datasets());
+				return TCL_OK;
+			case GETNAME:
+				if (objc != 3 || !hdfppcmd_index(objv[2], index)) break;
+				hdfppcmd_result(interp, h->getname(index));
+				return TCL_OK;
+			case GETINDEX: {
+				if (objc != 3) break;
+				int len;
+				const char *name = Tcl_GetStringFromObj(objv[2], &len);
+				hdfppcmd_result(interp, h->getindex(std::string(name, len)));
+				return TCL_OK;
+			}
+			case GETINFO:
+				if (objc != 3 || !hdfppcmd_index(objv[2], index)) break;
+				hdfppcmd_result(interp, h->getinfo(index));
+				return TCL_OK;
+			case READDATA:
+				if (objc != 3 || !hdfppcmd_index(objv[2], index)) break;
+				hdfppcmd_result(interp, h->readdata(index));
+				return TCL_OK;
+			case READATTRS:
+				if (objc != 3 || !hdfppcmd_index(objv[2], index)) break;
+				hdfppcmd_result(interp, h->readattrs(index));
+				return TCL_OK;
+			case READGLOBALATTRS:
+				if (objc != 2) break;
+				hdfppcmd_result(interp, h->readglobalattrs());
+				return TCL_OK;
+			case DUMP:
+				if (objc != 2) break;
+				hdfppcmd_result(interp, h->dump());
+				return TCL_OK;
+		}
+	} catch (...) {
+		return hdfppcmd_error(interp);
+	}
+	return TCL_CONTINUE;
+}
+
+static int hdfppcmd_hdfpp_object(ClientData clientData, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+	swig_instance *inst = static_cast<swig_instance*>(clientData);
+	if (objc >= 2 && inst->thisvalue) {
+		int code = hdfppcmd_hdfpp_call(static_cast<HDFpp*>(inst->thisvalue), interp, objc, objv);
+		if (code != TCL_CONTINUE) return code;
+	}
+	return hdfppcmd_hdfpp.method(clientData, interp, objc, objv);
+}
+
+#ifdef HAVE_HDF5
+static hdfppcmd_class hdfppcmd_h5pp;
+
+static const char *const hdfppcmd_h5pp_methods[] = {
+	"dump", "readframe", "stats", NULL
+};
+
+static int hdfppcmd_h5pp_call(H5pp *h, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+	enum { DUMP, READFRAME, STATS };
+	int method = hdfppcmd_method(objv[1], hdfppcmd_h5pp_methods);
+	try {
+		switch (method) {
+			case DUMP: {
+				int maxlevel = 0;
+				if (objc > 4 || (objc > 2 && !hdfppcmd_int(objv[2], maxlevel))) break;
+				hdfppcmd_result(interp, h->dump(maxlevel, objc > 3 ? Tcl_GetString(objv[3]) : "/"));
+				return TCL_OK;
+			}
+			case READFRAME: {
+				long frame = 0;
+				if (objc < 3 || objc > 4 || (objc > 3 && !hdfppcmd_long(objv[3], frame))) break;
+				hdfppcmd_result(interp, h->readframe(Tcl_GetString(objv[2]), frame));
+				return TCL_OK;
+			}
+			case STATS: {
+				if (objc < 3 || objc > 4) break;
+				std::string member;
+				if (objc > 3) {
+					int len;
+					const char *s = Tcl_GetStringFromObj(objv[3], &len);
+					member.assign(s, len);
+				}
+				hdfppcmd_result(interp, h->stats(Tcl_GetString(objv[2]), member));
+				return TCL_OK;
+			}
+		}
+	} catch (...) {
+		return hdfppcmd_error(interp);
+	}
+	return TCL_CONTINUE;
+}
+
+static int hdfppcmd_h5pp_object(ClientData clientData, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+	swig_instance *inst = static_cast<swig_instance*>(clientData);
+	if (objc >= 2 && inst->thisvalue) {
+		int code = hdfppcmd_h5pp_call(static_cast<H5pp*>(inst->thisvalue), interp, objc, objv);
+		if (code != TCL_CONTINUE) return code;
+	}
+	return hdfppcmd_h5pp.method(clientData, interp, objc, objv);
+}
+#endif
+
+// SWIG creates the object, then its command gets the fast procedure
+static int hdfppcmd_construct(hdfppcmd_class &cls, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+	int code = cls.constructor.objProc(cls.constructor.objClientData, interp, objc, objv);
+	if (code != TCL_OK) return code;
+	// the result is the name of the object command, whose clientData is
+	// the instance of the class given as clientData to the constructor
+	Tcl_CmdInfo info;
+	if (!Tcl_GetCommandInfo(interp, Tcl_GetStringResult(interp), &info) || info.isNativeObjectProc != 1) return code;
+	swig_instance *inst = static_cast<swig_instance*>(info.objClientData);
+	if (!inst || inst->classptr != static_cast<swig_class*>(cls.constructor.objClientData)) return code;
+	// all objects of a class share the SWIG method procedure
+	if (!cls.method) cls.method = info.objProc;
+	if (info.objProc != cls.method) return code;
+	info.objProc = cls.fast;
+	Tcl_SetCommandInfo(interp, Tcl_GetStringResult(interp), &info);
+	return code;
+}
+
+static int hdfppcmd_hdfpp_new(ClientData, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+	return hdfppcmd_construct(hdfppcmd_hdfpp, interp, objc, objv);
+}
+
+#ifdef HAVE_HDF5
+static int hdfppcmd_h5pp_new(ClientData, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+	return hdfppcmd_construct(hdfppcmd_h5pp, interp, objc, objv);
+}
+#endif
+
+static void hdfppcmd_hook(Tcl_Interp *interp, const char *classname, hdfppcmd_class &cls, Tcl_ObjCmdProc *construct, Tcl_ObjCmdProc *fast) {
+	Tcl_CmdInfo info;
+	if (!Tcl_GetCommandInfo(interp, classname, &info) || info.isNativeObjectProc != 1) return;
+	cls.constructor = info;
+	cls.method = NULL;
+	cls.fast = fast;
+	// the clientData of SWIG stays, the original procedure gets it from cls
+	info.objProc = construct;
+	Tcl_SetCommandInfo(interp, classname, &info);
+}
+
+// called from the package initialization, after SWIG has created the commands
+static void hdfppcmd_init(Tcl_Interp *interp) {
+	hdfppcmd_hook(interp, "HDFpp", hdfppcmd_hdfpp, hdfppcmd_hdfpp_new, hdfppcmd_hdfpp_object);
+#ifdef HAVE_HDF5
+	hdfppcmd_hook(interp, "H5pp", hdfppcmd_h5pp, hdfppcmd_h5pp_new, hdfppcmd_h5pp_object);
+#endif
+}
+
+#endif // HDFPPCMD_HPP
@@ -0,0 +1,235 @@
+/*  jsonwriter.hpp
+*
+*   (C) Copyright 2021 Physikalisch-Technische Bundesanstalt (PTB)
+*   Christian Gollwitzer
+*
+*   This file is part of BessyHDFViewer.
+*
+*   BessyHDFViewer is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   BessyHDFViewer is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with BessyHDFViewer.  If not, see <https://www.gnu.org/licenses/>.
+**
+*/
+
+/** Buffered JSON output to a file, for exporting dumps without
+ * building interpreter objects. The caller is responsible for the
+ * structure (commas, brackets), the writer for escaping and number formatting.
+ **/
+
+#ifndef JSONWRITER_HPP
+#define JSONWRITER_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+class json_writer {
+	FILE *out;
+	std::vector<char> buf;
+	std::size_t fill;
+
+	void reserve(std::size_t n) {
+		if (fill + n > buf.size()) flush();
+	}
+
+	// length of a valid UTF-8 sequence starting at s, 0 if invalid
+	static std::size_t utf8_sequence(const unsigned char *s, std::size_t len) {
+		std::size_t n;
+		if ((s[0] & 0xE0) == 0xC0) n = 2;
+		else if ((s[0] & 0xF0) == 0xE0) n = 3;
+		else if ((s[0] & 0xF8) == 0xF0) n = 4;
+		else return 0;
+		if (n > len) return 0;
+		for (std::size_t i = 1; i < n; i++) {
+			if ((s[i] & 0xC0) != 0x80) return 0;
+		}
+		return n;
+	}
+
+public:
+	json_writer(const char *fname) : out(NULL), buf(1 << 16), fill(0) {
+		out = fopen(fname, "wb");
+		if (!out) throw std::runtime_error(std::string("Can't open ") + fname + " for writing");
+	}
+
+	// without close(), e.g. when unwinding from an error, the buffered
+	// output is dropped, as flush() could throw
+	~json_writer() {
+		if (out) fclose(out);
+	}
+
+	void flush() {
+		if (fill > 0 && out) {
+			if (fwrite(&buf[0], 1, fill, out) != fill) {
+				fill = 0;
+				throw std::runtime_error("Error writing JSON output");
+			}
+		}
+		fill = 0;
+	}
+
+	void close() {
+		if (!out) return;
+		try {
+			flush();
+		} catch (...) {
+			fclose(out);
+			out = NULL;
+			throw;
+		}
+		int status = fclose(out);
+		out = NULL;
+		if (status != 0) throw std::runtime_error("Error writing JSON output");
+	}
+
+	void put(char c) {
+		reserve(1);
+		buf[fill++] = c;
+	}
+
+	void put(const char *s, std::size_t len) {
+		if (len > buf.size()) {
+			flush();
+			if (fwrite(s, 1, len, out) != len) throw std::runtime_error("Error writing JSON output");
+			return;
+		}
+		reserve(len);
+		std::memcpy(&buf[fill], s, len);
+		fill += len;
+	}
+
+	void put(const char *s) {
+		put(s, std::strlen(s));
+	}
+
+	// quoted string. Bytes which are not valid UTF-8 are written
+	// as \u00XX, i.e. read as ISO-8859-1 like a Tcl byte array
+	void string(const char *s, std::size_t len) {
+		static const char hex[] = "0123456789abcdef";
+		const unsigned char *u = reinterpret_cast<const unsigned char*>(s);
+		put('"');
+		std::size_t run = 0; // start of the pending unescaped run
+		for (std::size_t i = 0; i < len; ) {
+			unsigned char c = u[i];
+			if (c >= 0x20 && c != '"' && c != '\\' && c < 0x80) {
+				i++;
+				continue;
+			}
+			if (c >= 0x80) {
+				std::size_t n = utf8_sequence(u + i, len - i);
+				if (n > 0) {
+					i += n;
+					continue;
+				}
+			}
+			put(s + run, i - run);
+			char esc[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+			switch (c) {
+				case '"': put("\\\"", 2); break;
+				case '\\': put("\\\\", 2); break;
+				case '\n': put("\\n", 2); break;
+				case '\t': put("\\t", 2); break;
+				case '\r': put("\\r", 2); break;
+				default: put(esc, 6);
+			}
+			i++;
+			run = i;
+		}
+		put(s + run, len - run);
+		put('"');
+	}
+
+	void string(const std::string& s) {
+		string(s.c_str(), s.size());
+	}
+
+	// "key":
+	void key(const char *k) {
+		string(k, std::strlen(k));
+		put(':');
+	}
+
+	void number(long long v) {
+		char digits[24];
+		char *p = digits + sizeof(digits);
+		unsigned long long mag = v < 0 ? 0ULL - static_cast<unsigned long long>(v) : v;
+		do {
+			*--p = '0' + mag % 10;
+			mag /= 10;
+		} while (mag);
+		if (v < 0) *--p = '-';
+		put(p, digits + sizeof(digits) - p);
+	}
+
+	void number(unsigned long long v) {
+		char digits[24];
+		char *p = digits + sizeof(digits);
+		do {
+			*--p = '0' + v % 10;
+			v /= 10;
+		} while (v);
+		put(p, digits + sizeof(digits) - p);
+	}
+
+	// shortest representation which reads back to the same value.
+	// JSON has no NaN or Inf, they become null
+	void number(double v) {
+		if (v != v || v - v != 0) {
+			put("null", 4);
+			return;
+		}
+		if (v == static_cast<double>(static_cast<long long>(v)) && v < 1e15 && v > -1e15) {
+			// integral values, written like Tcl does
+			number(static_cast<long long>(v));
+			put(".0", 2);
+			return;
+		}
+		// fast path for values with few decimals: if m / 10^k reproduces v,
+		// the decimal m*10^-k reads back as v, because the division
+		// is correctly rounded like strtod
+		static const double p10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8 };
+		double mag = v < 0 ? -v : v;
+		if (mag >= 1e-3 && mag < 1e7) {
+			for (int k = 1; k <= 8; k++) {
+				double m = static_cast<double>(static_cast<long long>(v * p10[k] + (v < 0 ? -0.5 : 0.5)));
+				if (m / p10[k] != v) continue;
+				long long mant = static_cast<long long>(m < 0 ? -m : m);
+				char digits[32];
+				char *p = digits + sizeof(digits);
+				for (int d = 0; d < k; d++) {
+					*--p = '0' + mant % 10;
+					mant /= 10;
+				}
+				*--p = '.';
+				do {
+					*--p = '0' + mant % 10;
+					mant /= 10;
+				} while (mant);
+				if (v < 0) *--p = '-';
+				put(p, digits + sizeof(digits) - p);
+				return;
+			}
+		}
+		char digits[32];
+		int len = 0;
+		for (int prec = 15; prec <= 17; prec++) {
+			len = snprintf(digits, sizeof(digits), "%.*g", prec, v);
+			if (prec == 17 || std::strtod(digits, NULL) == v) break;
+		}
+		put(digits, len);
+	}
+};
+
+#endif // JSONWRITER_HPP
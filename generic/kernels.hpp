@@ -0,0 +1,271 @@
+/*  kernels.hpp
+*
+*   (C) Copyright 2021 Physikalisch-Technische Bundesanstalt (PTB)
+*   Christian Gollwitzer
+*
+*   This file is part of BessyHDFViewer.
+*
+*   BessyHDFViewer is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   BessyHDFViewer is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with BessyHDFViewer.  If not, see <https://www.gnu.org/licenses/>.
+**
+*/
+
+/** Reduction kernels over blocks of double values.
+ * On x86_64, SSE2 is always available and used directly;
+ * other platforms get a lane-wise version which the compiler can vectorize.
+ * NaN values are skipped by all reductions.
+ **/
+
+#ifndef KERNELS_HPP
+#define KERNELS_HPP
+
+#include <cstddef>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define KERNELS_SSE2
+#endif
+
+// minimum and maximum of a block, updating mn and mx
+inline void kernel_minmax(const double *v, std::size_t n, double &mn, double &mx) {
+	std::size_t i = 0;
+#ifdef KERNELS_SSE2
+	// minpd/maxpd return the second operand if one is NaN,
+	// so NaN values never replace the accumulator
+	__m128d vmn = _mm_set1_pd(mn);
+	__m128d vmx = _mm_set1_pd(mx);
+	for (; i+4 <= n; i+=4) {
+		__m128d a = _mm_loadu_pd(v+i);
+		__m128d b = _mm_loadu_pd(v+i+2);
+		vmn = _mm_min_pd(a, vmn);
+		vmx = _mm_max_pd(a, vmx);
+		vmn = _mm_min_pd(b, vmn);
+		vmx = _mm_max_pd(b, vmx);
+	}
+	double lanes[2];
+	_mm_storeu_pd(lanes, vmn);
+	mn = lanes[0] < lanes[1] ? lanes[0] : lanes[1];
+	_mm_storeu_pd(lanes, vmx);
+	mx = lanes[0] > lanes[1] ? lanes[0] : lanes[1];
+#else
+	double lmn[4] = { mn, mn, mn, mn };
+	double lmx[4] = { mx, mx, mx, mx };
+	for (; i+4 <= n; i+=4) {
+		for (int j = 0; j < 4; j++) {
+			lmn[j] = v[i+j] < lmn[j] ? v[i+j] : lmn[j];
+			lmx[j] = v[i+j] > lmx[j] ? v[i+j] : lmx[j];
+		}
+	}
+	for (int j = 0; j < 4; j++) {
+		if (lmn[j] < mn) mn = lmn[j];
+		if (lmx[j] > mx) mx = lmx[j];
+	}
+#endif
+	for (; i < n; i++) {
+		if (v[i] < mn) mn = v[i];
+		if (v[i] > mx) mx = v[i];
+	}
+}
+
+// sum and number of the non-NaN values of a block, updating sum and count
+inline void kernel_sum(const double *v, std::size_t n, double &sum, std::size_t &count) {
+	std::size_t i = 0;
+#ifdef KERNELS_SSE2
+	__m128d vsum = _mm_setzero_pd();
+	__m128d vcnt = _mm_setzero_pd();
+	const __m128d one = _mm_set1_pd(1.0);
+	for (; i+2 <= n; i+=2) {
+		__m128d a = _mm_loadu_pd(v+i);
+		// all ones for non-NaN values
+		__m128d valid = _mm_cmpord_pd(a, a);
+		vsum = _mm_add_pd(vsum, _mm_and_pd(valid, a));
+		vcnt = _mm_add_pd(vcnt, _mm_and_pd(valid, one));
+	}
+	double lanes[2];
+	_mm_storeu_pd(lanes, vsum);
+	sum += lanes[0] + lanes[1];
+	_mm_storeu_pd(lanes, vcnt);
+	count += static_cast<std::size_t>(lanes[0] + lanes[1]);
+#else
+	double lsum[4] = { 0.0, 0.0, 0.0, 0.0 };
+	std::size_t lcnt[4] = { 0, 0, 0, 0 };
+	for (; i+4 <= n; i+=4) {
+		for (int j = 0; j < 4; j++) {
+			bool valid = (v[i+j] == v[i+j]);
+			lsum[j] += valid ? v[i+j] : 0.0;
+			lcnt[j] += valid;
+		}
+	}
+	for (int j = 0; j < 4; j++) {
+		sum += lsum[j];
+		count += lcnt[j];
+	}
+#endif
+	for (; i < n; i++) {
+		if (v[i] == v[i]) {
+			sum += v[i];
+			count++;
+		}
+	}
+}
+
+// sum of squared deviations of the non-NaN values from mean
+inline double kernel_sqdev(const double *v, std::size_t n, double mean) {
+	double result = 0.0;
+	std::size_t i = 0;
+#ifdef KERNELS_SSE2
+	__m128d vres = _mm_setzero_pd();
+	const __m128d vmean = _mm_set1_pd(mean);
+	for (; i+2 <= n; i+=2) {
+		__m128d a = _mm_loadu_pd(v+i);
+		__m128d valid = _mm_cmpord_pd(a, a);
+		__m128d dev = _mm_and_pd(valid, _mm_sub_pd(a, vmean));
+		vres = _mm_add_pd(vres, _mm_mul_pd(dev, dev));
+	}
+	double lanes[2];
+	_mm_storeu_pd(lanes, vres);
+	result = lanes[0] + lanes[1];
+#else
+	double lres[4] = { 0.0, 0.0, 0.0, 0.0 };
+	for (; i+4 <= n; i+=4) {
+		for (int j = 0; j < 4; j++) {
+			double dev = v[i+j] - mean;
+			lres[j] += (v[i+j] == v[i+j]) ? dev*dev : 0.0;
+		}
+	}
+	result = lres[0] + lres[1] + lres[2] + lres[3];
+#endif
+	for (; i < n; i++) {
+		if (v[i] == v[i]) {
+			double dev = v[i] - mean;
+			result += dev*dev;
+		}
+	}
+	return result;
+}
+
+enum kernel_op { kernel_add, kernel_sub, kernel_mul, kernel_div };
+
+// elementwise out = a op b, out may alias a or b
+inline void kernel_binop(kernel_op op, const double *a, const double *b, double *out, std::size_t n) {
+	std::size_t i = 0;
+#ifdef KERNELS_SSE2
+	switch (op) {
+		case kernel_add:
+			for (; i+2 <= n; i+=2) _mm_storeu_pd(out+i, _mm_add_pd(_mm_loadu_pd(a+i), _mm_loadu_pd(b+i)));
+			break;
+		case kernel_sub:
+			for (; i+2 <= n; i+=2) _mm_storeu_pd(out+i, _mm_sub_pd(_mm_loadu_pd(a+i), _mm_loadu_pd(b+i)));
+			break;
+		case kernel_mul:
+			for (; i+2 <= n; i+=2) _mm_storeu_pd(out+i, _mm_mul_pd(_mm_loadu_pd(a+i), _mm_loadu_pd(b+i)));
+			break;
+		case kernel_div:
+			for (; i+2 <= n; i+=2) _mm_storeu_pd(out+i, _mm_div_pd(_mm_loadu_pd(a+i), _mm_loadu_pd(b+i)));
+			break;
+	}
+#endif
+	// one loop per operation, so that the compiler can vectorize each
+	switch (op) {
+		case kernel_add: for (; i < n; i++) out[i] = a[i] + b[i]; break;
+		case kernel_sub: for (; i < n; i++) out[i] = a[i] - b[i]; break;
+		case kernel_mul: for (; i < n; i++) out[i] = a[i] * b[i]; break;
+		case kernel_div: for (; i < n; i++) out[i] = a[i] / b[i]; break;
+	}
+}
+
+// linear interpolation out = a + w*(b-a)
+inline void kernel_lerp(const double *a, const double *b, const double *w, double *out, std::size_t n) {
+	std::size_t i = 0;
+#ifdef KERNELS_SSE2
+	for (; i+2 <= n; i+=2) {
+		__m128d va = _mm_loadu_pd(a+i);
+		__m128d diff = _mm_sub_pd(_mm_loadu_pd(b+i), va);
+		_mm_storeu_pd(out+i, _mm_add_pd(va, _mm_mul_pd(_mm_loadu_pd(w+i), diff)));
+	}
+#endif
+	for (; i < n; i++) out[i] = a[i] + w[i]*(b[i] - a[i]);
+}
+
+// per element running statistics over a stack of blocks: 
+// count, mean and squared deviations (Welford), sum, min and max
+struct kernel_accumulator {
+	double *count;
+	double *mean;
+	double *m2;
+	double *sum;
+	double *mn;
+	double *mx;
+};
+
+// add the block v to the accumulator elements [0, n)
+inline void kernel_accumulate(const double *v, std::size_t n, const kernel_accumulator &acc) {
+	std::size_t i = 0;
+#ifdef KERNELS_SSE2
+	const __m128d one = _mm_set1_pd(1.0);
+	for (; i+2 <= n; i+=2) {
+		__m128d a = _mm_loadu_pd(v+i);
+		__m128d valid = _mm_cmpord_pd(a, a);
+		__m128d cnt = _mm_add_pd(_mm_loadu_pd(acc.count+i), _mm_and_pd(valid, one));
+		__m128d mean = _mm_loadu_pd(acc.mean+i);
+		__m128d delta = _mm_and_pd(valid, _mm_sub_pd(a, mean));
+		__m128d newmean = _mm_add_pd(mean, _mm_div_pd(delta, _mm_max_pd(cnt, one)));
+		__m128d m2inc = _mm_and_pd(valid, _mm_mul_pd(delta, _mm_sub_pd(a, newmean)));
+		_mm_storeu_pd(acc.count+i, cnt);
+		_mm_storeu_pd(acc.mean+i, newmean);
+		_mm_storeu_pd(acc.m2+i, _mm_add_pd(_mm_loadu_pd(acc.m2+i), m2inc));
+		_mm_storeu_pd(acc.sum+i, _mm_add_pd(_mm_loadu_pd(acc.sum+i), _mm_and_pd(valid, a)));
+		_mm_storeu_pd(acc.mn+i, _mm_min_pd(a, _mm_loadu_pd(acc.mn+i)));
+		_mm_storeu_pd(acc.mx+i, _mm_max_pd(a, _mm_loadu_pd(acc.mx+i)));
+	}
+#endif
+	for (; i < n; i++) {
+		if (v[i] != v[i]) continue;
+		acc.count[i] += 1.0;
+		double delta = v[i] - acc.mean[i];
+		acc.mean[i] += delta / acc.count[i];
+		acc.m2[i] += delta * (v[i] - acc.mean[i]);
+		acc.sum[i] += v[i];
+		if (v[i] < acc.mn[i]) acc.mn[i] = v[i];
+		if (v[i] > acc.mx[i]) acc.mx[i] = v[i];
+	}
+}
+
+// histogram with nbins equal bins starting at lo, each 1/scale wide. 
+// The upper edge belongs to the last bin
+inline void kernel_histogram(const double *v, std::size_t n, double lo, double scale, std::size_t nbins, long long *counts, std::size_t &outside, std::size_t &nans) {
+	// bin positions are computed in chunks by a vectorizable loop,
+	// the counting itself is a scatter
+	const std::size_t chunk = 256;
+	double pos[chunk];
+	const double top = static_cast<double>(nbins);
+	for (std::size_t start = 0; start < n; start += chunk) {
+		std::size_t len = (n - start < chunk) ? n - start : chunk;
+		for (std::size_t i = 0; i < len; i++) pos[i] = (v[start+i] - lo) * scale;
+		for (std::size_t i = 0; i < len; i++) {
+			double p = pos[i];
+			if (p != p) {
+				nans++;
+			} else if (p < 0.0 || p > top) {
+				outside++;
+			} else {
+				std::size_t bin = static_cast<std::size_t>(p);
+				if (bin >= nbins) bin = nbins - 1;
+				counts[bin]++;
+			}
+		}
+	}
+}
+
+#endif // KERNELS_HPP
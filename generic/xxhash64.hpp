@@ -0,0 +1,159 @@
+/*  xxhash64.hpp
+*
+*   (C) Copyright 2021 Physikalisch-Technische Bundesanstalt (PTB)
+*   Christian Gollwitzer
+*
+*   This file is part of BessyHDFViewer.
+*
+*   BessyHDFViewer is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   BessyHDFViewer is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with BessyHDFViewer.  If not, see <https://www.gnu.org/licenses/>.
+**
+*/
+
+/** Streaming XXH64 hash for content fingerprints. The result is identical
+ * to the reference implementation of xxHash (XXH64 with the same seed),
+ * independent of how the input is split into update calls.
+ **/
+
+#ifndef XXHASH64_HPP
+#define XXHASH64_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+class xxh64 {
+	typedef unsigned long long u64;
+	static const u64 p1 = 0x9E3779B185EBCA87ULL;
+	static const u64 p2 = 0xC2B2AE3D27D4EB4FULL;
+	static const u64 p3 = 0x165667B19E3779F9ULL;
+	static const u64 p4 = 0x85EBCA77C2B2AE63ULL;
+	static const u64 p5 = 0x27D4EB2F165667C5ULL;
+
+	u64 v[4];
+	u64 seed;
+	u64 total;
+	unsigned char pending[32];
+	std::size_t npending;
+
+	static u64 rotl(u64 x, int r) {
+		return (x << r) | (x >> (64 - r));
+	}
+
+	// byte-wise little endian loads, independent of alignment and host byte order
+	static u64 read64(const unsigned char *p) {
+		u64 x = 0;
+		for (int i = 7; i >= 0; i--) x = (x << 8) | p[i];
+		return x;
+	}
+
+	static u64 read32(const unsigned char *p) {
+		return (u64)p[0] | ((u64)p[1] << 8) | ((u64)p[2] << 16) | ((u64)p[3] << 24);
+	}
+
+	static u64 round(u64 acc, u64 input) {
+		acc += input * p2;
+		acc = rotl(acc, 31);
+		return acc * p1;
+	}
+
+	static u64 merge(u64 acc, u64 val) {
+		acc ^= round(0, val);
+		return acc * p1 + p4;
+	}
+
+	void stripe(const unsigned char *p) {
+		v[0] = round(v[0], read64(p));
+		v[1] = round(v[1], read64(p + 8));
+		v[2] = round(v[2], read64(p + 16));
+		v[3] = round(v[3], read64(p + 24));
+	}
+
+public:
+	explicit xxh64(u64 seed_ = 0) {
+		reset(seed_);
+	}
+
+	void reset(u64 seed_ = 0) {
+		seed = seed_;
+		v[0] = seed + p1 + p2;
+		v[1] = seed + p2;
+		v[2] = seed;
+		v[3] = seed - p1;
+		total = 0;
+		npending = 0;
+	}
+
+	void update(const void *data, std::size_t len) {
+		const unsigned char *p = static_cast<const unsigned char*>(data);
+		total += len;
+		if (npending + len < 32) {
+			if (len > 0) std::memcpy(pending + npending, p, len);
+			npending += len;
+			return;
+		}
+		if (npending > 0) {
+			std::size_t fill = 32 - npending;
+			std::memcpy(pending + npending, p, fill);
+			stripe(pending);
+			p += fill;
+			len -= fill;
+			npending = 0;
+		}
+		for (; len >= 32; p += 32, len -= 32) stripe(p);
+		if (len > 0) std::memcpy(pending, p, len);
+		npending = len;
+	}
+
+	void update(const std::string& s) {
+		update(s.data(), s.size());
+	}
+
+	// hash of the input so far, more input can follow
+	u64 digest() const {
+		u64 h;
+		if (total >= 32) {
+			h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18);
+			for (int i = 0; i < 4; i++) h = merge(h, v[i]);
+		} else {
+			h = seed + p5;
+		}
+		h += total;
+
+		const unsigned char *p = pending;
+		std::size_t len = npending;
+		for (; len >= 8; p += 8, len -= 8) {
+			h ^= round(0, read64(p));
+			h = rotl(h, 27) * p1 + p4;
+		}
+		if (len >= 4) {
+			h ^= read32(p) * p1;
+			h = rotl(h, 23) * p2 + p3;
+			p += 4;
+			len -= 4;
+		}
+		for (; len > 0; p++, len--) {
+			h ^= *p * p5;
+			h = rotl(h, 11) * p1;
+		}
+
+		h ^= h >> 33;
+		h *= p2;
+		h ^= h >> 29;
+		h *= p3;
+		h ^= h >> 32;
+		return h;
+	}
+};
+
+#endif // XXHASH64_HPP